@@ -0,0 +1,152 @@
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+
+#include "chess.hpp"
+
+/* Command line search mode, searches one position and prints the progress of
+ * every iteration and the best move:
+ *   main search [<FEN> | <board file>] [options]   default is the initial position
+ * options:
+ *   --depth <d>       maximum depth
+ *   --movetime <ms>   time limit
+ *   --nodes <n>       node limit
+ *   --hash <MB>       size of the transposition table, default 16
+ *   --threads <n>     search threads (Lazy SMP), default 1
+ *   --speedup         searches twice, on one and on --threads threads, each with an
+ *                     empty table, and compares the time to every depth
+ *   --no-aspiration, --no-pvs, --no-null-move, --no-tt, --no-quiescence, --no-history
+ *                     switch a search feature off, e.g. to compare the nodes to a depth
+ *   --trace <file>    writes a Chrome trace of the search (builds with -DINSTRUMENT)
+ *   --nnue <file>     evaluates with the network in >>file<< (builds with -DUSE_NNUE)
+ *   --book <file>     plays from the Polyglot book in >>file<<, see book.hpp
+ *   --tb <directory>  probes the endgame tablebases in the directory, see tablebase.hpp
+ * Without any limit the search goes to depth 8.
+ */
+
+void printSpeedup(ChessBoard& chess_board, const SearchLimits& limits, const SearchFeatures& features) {
+	/* time to depth of a single threaded and a multi threaded search
+	 */
+	int threads = chess_board._threads;
+	vector<SearchResult> iterations[2];  // [single, multi threaded]
+	for (int run = 0; run < 2; run++) {
+		chess_board._threads = run ? threads : 1;
+		chess_board._tt.reset();  // the second run must not profit from the table of the first
+		chess_board.search(limits, features, false, [&](const SearchResult& r) { iterations[run].push_back(r); });
+	}
+	chess_board._threads = threads;
+
+	cout << "depth   1 thread ms   " << setw(2) << threads << " threads ms   speedup        nodes 1      nodes " << threads << endl;
+	for (size_t i = 0; i < min(iterations[0].size(), iterations[1].size()); i++) {
+		const SearchResult& single = iterations[0][i];
+		auto multi = find_if(iterations[1].begin(), iterations[1].end(), [&](auto& r) { return r._depth == single._depth; });
+		if (multi == iterations[1].end())
+			continue;
+		cout << setw(5) << single._depth << fixed << setprecision(1)
+		     << setw(14) << single._seconds * 1000 << setw(16) << multi->_seconds * 1000
+		     << setw(10) << setprecision(2) << (multi->_seconds > 0 ? single._seconds / multi->_seconds : 0.0)
+		     << setw(15) << single._nodes << setw(15) << multi->_nodes << endl;
+	}
+	if (!iterations[1].empty()) {
+		const SearchResult& last = iterations[1].back();
+		for (size_t id = 0; id < last._thread_nodes.size(); id++)
+			cout << "thread " << id << " nodes " << last._thread_nodes[id] << endl;
+	}
+}
+
+int analysisMain(int argc, char* argv[]) {
+	SearchLimits limits;
+	SearchFeatures features;
+	ChessBoard chess_board;
+	string source, trace_file, book_file, tablebase_path;
+	bool limited = false, speedup = false;
+
+	for (int i = 2; i < argc; i++) {
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--depth" && has_value) {
+			limits._depth = max(1, atoi(argv[++i]));
+			limited = true;
+		} else if (arg == "--movetime" && has_value) {
+			limits._movetime_ms = max(1, atoi(argv[++i]));
+			limited = true;
+		} else if (arg == "--nodes" && has_value) {
+			limits._nodes = strtoull(argv[++i], nullptr, 10);
+			limited = true;
+		} else if (arg == "--hash" && has_value) {
+			chess_board._hash_mb = max(1, atoi(argv[++i]));
+		} else if (arg == "--threads" && has_value) {
+			chess_board._threads = max(1, atoi(argv[++i]));
+		} else if (arg == "--speedup") {
+			speedup = true;
+		} else if (arg == "--trace" && has_value) {
+			trace_file = argv[++i];
+		} else if (arg == "--nnue" && has_value) {
+#ifdef USE_NNUE
+			try {
+				NNUE.load(argv[++i]);
+			} catch (const exception& e) {
+				cout << e.what() << endl;
+				return 2;
+			}
+			cout << "nnue " << argv[i] << " kernel " << NNUE_KERNEL_NAMES[nnue_kernel] << endl;
+#else
+			cout << "--nnue needs a build with -DUSE_NNUE" << endl;
+			return 2;
+#endif
+		} else if (arg == "--book" && has_value) {
+			book_file = argv[++i];
+		} else if (arg == "--tb" && has_value) {
+			tablebase_path = argv[++i];
+		} else if (arg == "--no-aspiration") {
+			features._aspiration = false;
+		} else if (arg == "--no-pvs") {
+			features._pvs = false;
+		} else if (arg == "--no-null-move") {
+			features._null_move = false;
+		} else if (arg == "--no-tt") {
+			features._tt = false;
+		} else if (arg == "--no-quiescence") {
+			features._quiescence = false;
+		} else if (arg == "--no-history") {
+			features._history = false;
+		} else if (arg.substr(0, 2) == "--") {
+			cout << "Unknown option " << arg << endl;
+			return 2;
+		} else {
+			source += (source.empty() ? "" : " ") + arg;  // an unquoted FEN arrives as several arguments
+		}
+	}
+	if (!limited)
+		limits._depth = 8;
+
+	try {
+		if (!book_file.empty())
+			BOOK.load(book_file);
+		if (!tablebase_path.empty()) {
+			vector<string> errors;
+			cout << TABLEBASES.loadDirectory(tablebase_path, errors) << " tablebases loaded" << endl;
+			for (const string& error : errors)
+				cout << error << endl;
+		}
+		chess_board.loadPosition(source.empty() ? START_FEN : source);
+	} catch (const exception& e) {
+		cout << e.what() << endl;
+		return 2;
+	}
+
+	if (speedup) {
+		printSpeedup(chess_board, limits, features);
+		return 0;
+	}
+
+	if (!trace_file.empty())
+		startTrace();
+	SearchResult result = chess_board.search(limits, features, true);
+	if (traceActive())
+		stopTrace(trace_file);
+
+	cout << "bestmove " << (result._best_move ? chess_board.moveToNotation(result._best_move) : "none") << endl;
+	return 0;
+}
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef ATTACKS_HPP
+#define ATTACKS_HPP
+
+#include "bitboard.hpp"
+#include <array>
+#include <stdexcept>
+
+#ifdef USE_PEXT
+#include <immintrin.h>  // _pext_u64, requires -mbmi2
+#endif
+
+/* Attack tables of the leapers (knight, king) and of the pawns, plus the masks of
+ * the squares between and the line through two squares. They do not depend on the
+ * occupancy, so they are generated by the compiler and end up as constant data.
+ */
+typedef std::array<Bitboard, 64> SquareTable;
+
+constexpr Bitboard shiftedSquare(int sq, int delta_row, int delta_col) {
+	/* the square (row + delta_row, col + delta_col) as a bitboard, empty if off the board
+	 */
+	int row = rowOf(sq) + delta_row, col = colOf(sq) + delta_col;
+	return (row >= 0 && row < 8 && col >= 0 && col < 8) ? squareBB(makeSquare(row, col)) : 0;
+}
+
+constexpr SquareTable makeLeaperTable(const int (&deltas)[8][2]) {
+	SquareTable table {};
+	for (int sq = 0; sq < 64; sq++) {
+		for (int i = 0; i < 8; i++)
+			table[sq] |= shiftedSquare(sq, deltas[i][0], deltas[i][1]);
+	}
+	return table;
+}
+
+constexpr SquareTable makePawnTable(Color c) {
+	SquareTable table {};
+	int delta_row = (c == WHITE) ? 1 : -1;
+	for (int sq = 0; sq < 64; sq++)
+		table[sq] = shiftedSquare(sq, delta_row, -1) | shiftedSquare(sq, delta_row, 1);
+	return table;
+}
+
+constexpr int KNIGHT_DELTAS[8][2] {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
+constexpr int KING_DELTAS[8][2] {{1, 1}, {1, 0}, {1, -1}, {0, 1}, {0, -1}, {-1, 1}, {-1, 0}, {-1, -1}};
+
+constexpr SquareTable KNIGHT_ATTACKS = makeLeaperTable(KNIGHT_DELTAS);
+constexpr SquareTable KING_ATTACKS = makeLeaperTable(KING_DELTAS);
+constexpr std::array<SquareTable, 2> PAWN_ATTACKS {{makePawnTable(WHITE), makePawnTable(BLACK)}};  // [color][square]
+
+constexpr std::array<SquareTable, 64> makeBetweenTable(bool full_line) {
+	/* for every pair of squares on a common row, column or diagonal either the squares
+	 * strictly between them, or the whole line through both of them (edge to edge)
+	 */
+	std::array<SquareTable, 64> table {};
+	for (int from = 0; from < 64; from++) {
+		for (int d = 0; d < 8; d++) {
+			int delta_row = KING_DELTAS[d][0], delta_col = KING_DELTAS[d][1];
+			Bitboard ray = 0, between = 0;
+			for (int row = rowOf(from) + delta_row, col = colOf(from) + delta_col;
+			     row >= 0 && row < 8 && col >= 0 && col < 8; row += delta_row, col += delta_col)
+				ray |= squareBB(makeSquare(row, col));
+
+			for (int row = rowOf(from) + delta_row, col = colOf(from) + delta_col;
+			     row >= 0 && row < 8 && col >= 0 && col < 8; row += delta_row, col += delta_col) {
+				int to = makeSquare(row, col);
+				if (full_line) {
+					// the line is the ray in this direction, the opposite ray and both squares
+					Bitboard back = 0;
+					for (int r = rowOf(from) - delta_row, c = colOf(from) - delta_col;
+					     r >= 0 && r < 8 && c >= 0 && c < 8; r -= delta_row, c -= delta_col)
+						back |= squareBB(makeSquare(r, c));
+					table[from][to] = ray | back | squareBB(from);
+				} else {
+					table[from][to] = between;
+				}
+				between |= squareBB(to);
+			}
+		}
+	}
+	return table;
+}
+
+constexpr std::array<SquareTable, 64> BETWEEN_BB = makeBetweenTable(false);  // [from][to], excluding both
+constexpr std::array<SquareTable, 64> LINE_BB = makeBetweenTable(true);      // [from][to], 0 if not aligned
+
+inline Bitboard pawnAttacks(Color c, int sq) { return PAWN_ATTACKS[c][sq]; }
+inline Bitboard knightAttacks(int sq) { return KNIGHT_ATTACKS[sq]; }
+inline Bitboard kingAttacks(int sq) { return KING_ATTACKS[sq]; }
+inline Bitboard betweenBB(int from, int to) { return BETWEEN_BB[from][to]; }
+inline Bitboard lineBB(int from, int to) { return LINE_BB[from][to]; }
+inline bool aligned(int a, int b, int c) { return LINE_BB[a][b] & squareBB(c); }
+
+/* Precomputed sliding attacks for rooks and bishops (queens are the union of both).
+ * For every square only the relevant occupancy (the rays without the board edges)
+ * is looked at. It is mapped to a dense index either by a magic multiplication or,
+ * when compiled with -DUSE_PEXT -mbmi2, by the BMI2 PEXT instruction. The attacks
+ * for any occupancy are then a single table load.
+ */
+struct Magic {
+	Bitboard _mask;      // relevant occupancy of the square
+	Bitboard _magic;     // magic factor, unused with PEXT
+	Bitboard* _attacks;  // start of the square's slice in the attack table
+	unsigned _shift;
+
+	unsigned index(Bitboard occupied) const {
+#ifdef USE_PEXT
+		return unsigned(_pext_u64(occupied, _mask));
+#else
+		return unsigned(((occupied & _mask) * _magic) >> _shift);
+#endif
+	}
+};
+
+Magic ROOK_MAGICS[64];
+Magic BISHOP_MAGICS[64];
+Bitboard ROOK_TABLE[0x19000];   // 102400 entries, sum over all squares of 2^(relevant bits)
+Bitboard BISHOP_TABLE[0x1480];  // 5248 entries
+
+inline Bitboard rookAttacks(int sq, Bitboard occupied) {
+	return ROOK_MAGICS[sq]._attacks[ROOK_MAGICS[sq].index(occupied)];
+}
+
+inline Bitboard bishopAttacks(int sq, Bitboard occupied) {
+	return BISHOP_MAGICS[sq]._attacks[BISHOP_MAGICS[sq].index(occupied)];
+}
+
+inline Bitboard queenAttacks(int sq, Bitboard occupied) {
+	return rookAttacks(sq, occupied) | bishopAttacks(sq, occupied);
+}
+
+Bitboard slidingAttacks(PieceType type, int sq, Bitboard occupied) {
+	/* "shoots" into all directions of the piece and stops at the first occupied
+	 * square (which is included). Slow, only used to fill the tables.
+	 */
+	const int rook_deltas[4][2] {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+	const int bishop_deltas[4][2] {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+	const int (*deltas)[2] = (type == ROOK) ? rook_deltas : bishop_deltas;
+
+	Bitboard attacks = 0;
+	for (int d = 0; d < 4; d++) {
+		int row = rowOf(sq) + deltas[d][0], col = colOf(sq) + deltas[d][1];
+		while (row >= 0 && row < 8 && col >= 0 && col < 8) {
+			attacks |= squareBB(makeSquare(row, col));
+			if (occupied & squareBB(makeSquare(row, col))) break;  // collision
+			row += deltas[d][0];
+			col += deltas[d][1];
+		}
+	}
+	return attacks;
+}
+
+// xorshift64* generator, only used to search the magic factors
+struct MagicPRNG {
+	uint64_t _s;
+
+	MagicPRNG(uint64_t seed) : _s(seed) {}
+
+	uint64_t next() {
+		_s ^= _s >> 12;
+		_s ^= _s << 25;
+		_s ^= _s >> 27;
+		return _s * 2685821657736338717ULL;
+	}
+
+	uint64_t sparse() { return next() & next() & next(); }  // few set bits make good magic candidates
+};
+
+void initMagics(PieceType type, Bitboard table[], Magic magics[]) {
+	/* fills the magics and the attack table of one slider type. For every square
+	 * all subsets of the mask are enumerated (carry-rippler trick) and a magic
+	 * factor is searched, that maps them without destructive collisions.
+	 */
+	Bitboard reference[4096];
+	int size = 0;
+#ifndef USE_PEXT
+	const uint64_t seeds[8] {728, 10316, 55013, 32803, 12281, 15100, 16645, 255};  // per row, known to converge fast
+	Bitboard occupancy[4096];
+	int epoch[4096] = {}, attempt = 0;
+#endif
+
+	for (int sq = 0; sq < 64; sq++) {
+		// board edges are not relevant, unless the piece itself stands on them
+		Bitboard edges = ((RANK_1_BB | RANK_8_BB) & ~(RANK_1_BB << (8 * rowOf(sq))))
+		               | ((FILE_A_BB | FILE_H_BB) & ~(FILE_A_BB << colOf(sq)));
+
+		Magic& m = magics[sq];
+		m._mask = slidingAttacks(type, sq, 0) & ~edges;
+		m._shift = 64 - popCount(m._mask);
+		m._attacks = (sq == 0) ? table : magics[sq - 1]._attacks + size;
+
+		Bitboard b = 0;
+		size = 0;
+		do {
+			reference[size] = slidingAttacks(type, sq, b);
+#ifdef USE_PEXT
+			m._attacks[_pext_u64(b, m._mask)] = reference[size];
+#else
+			occupancy[size] = b;
+#endif
+			size++;
+			b = (b - m._mask) & m._mask;
+		} while (b);
+
+#ifndef USE_PEXT
+		MagicPRNG rng(seeds[rowOf(sq)]);
+		for (int i = 0; i < size; ) {
+			for (m._magic = 0; popCount((m._magic * m._mask) >> 56) < 6; )
+				m._magic = rng.sparse();
+
+			// epoch instead of clearing the table on every attempt
+			for (++attempt, i = 0; i < size; i++) {
+				unsigned idx = m.index(occupancy[i]);
+				if (epoch[idx] < attempt) {
+					epoch[idx] = attempt;
+					m._attacks[idx] = reference[i];
+				} else if (m._attacks[idx] != reference[i]) {
+					break;
+				}
+			}
+		}
+#endif
+	}
+}
+
+void initSlidingAttacks() {
+#ifdef USE_PEXT
+	if (!__builtin_cpu_supports("bmi2"))
+		throw std::runtime_error("Compiled with USE_PEXT, but this CPU does not support BMI2!");
+#endif
+	initMagics(ROOK, ROOK_TABLE, ROOK_MAGICS);
+	initMagics(BISHOP, BISHOP_TABLE, BISHOP_MAGICS);
+}
+
+// fills the tables once at program start, before main() runs
+struct AttackTablesInit {
+	AttackTablesInit() { initSlidingAttacks(); }
+} attack_tables_init;
+
+#endif
@@ -0,0 +1,352 @@
+#include "chess.hpp"
+#include "perft.hpp"
+#include <filesystem>
+#include <functional>
+
+/* Micro-benchmarks for the move generation and rules hot paths of ChessBoard.
+ *
+ * Build and run from the repository directory (the corpus includes the shipped
+ * board files):
+ *   g++ -std=c++17 -O2 -pthread bench.cpp -o bench
+ *   ./bench [--format table|csv|json] [--reps <n>] [--warmup <n>] [--min-rep-us <us>] [--filter <text>]
+ *           [--nnue <network file> | --nnue random]
+ *
+ * Every benchmark runs over every position of a fixed corpus. One repetition
+ * calls the benchmarked method often enough to take at least --min-rep-us, the
+ * time per call of every repetition is recorded and the median and percentiles
+ * are reported. The warm-up repetitions are not recorded.
+ * csv and json output are meant to be stored and diffed across commits.
+ *
+ * Built with -DUSE_NNUE -march=native and given a network ("random" writes and
+ * maps a network with random weights, which costs the same), the network
+ * evaluation is benchmarked as well, once with every kernel the CPU supports on
+ * the same positions, and the evaluations per second are listed per kernel:
+ *  - nnueForward.<kernel>: the layers after the accumulator, the cost of an
+ *    evaluation in the search
+ *  - nnueMakeUnmake.<kernel>: make and unmake every legal move with the
+ *    incremental accumulator updates
+ *  - nnueRefresh.<kernel>: recomputing both accumulators from the board
+ */
+
+using namespace std;
+
+uint64_t bench_sink = 0;  // results are added here, so the compiler cannot drop the calls
+
+struct BenchOptions {
+	string _format = "table";
+	int _reps = 30;
+	int _warmup = 5;
+	int _min_rep_us = 200;
+	string _filter;
+	string _nnue;  // network file, empty: no network benchmarks
+};
+
+struct BenchResult {
+	string _benchmark;
+	string _position;
+	int _calls;             // calls per repetition
+	vector<double> _ns;     // nanoseconds per call, one entry per repetition, sorted
+	double percentile(double p) const {
+		// nearest rank
+		size_t rank = size_t(ceil(p / 100 * _ns.size()));
+		return _ns[rank > 0 ? rank - 1 : 0];
+	}
+	double mean() const {
+		double sum = 0;
+		for (double ns : _ns) sum += ns;
+		return sum / _ns.size();
+	}
+};
+
+struct BenchPosition {
+	string _name;
+	string _source;  // board file or FEN
+};
+
+const vector<BenchPosition> BENCH_CORPUS {
+	{"starting_config", "starting_config.txt"},
+	{"fast_checkmate", "fast_checkmate.txt"},
+	{"kiwipete", PERFT_SUITE[1]._fen},
+	{"position3", PERFT_SUITE[2]._fen},
+	{"position4", PERFT_SUITE[3]._fen},
+	{"position5", PERFT_SUITE[4]._fen},
+};
+
+void loadBenchPosition(ChessBoard& chess_board, const BenchPosition& position) {
+	if (ifstream(position._source).good())
+		chess_board.loadBoard(position._source);
+	else if (position._source.find('/') != string::npos)
+		chess_board.loadFen(position._source);
+	else
+		throw runtime_error("Cannot open " + position._source + ", run the benchmark from the repository directory!");
+}
+
+BenchResult measure(const string& benchmark, const string& position, int calls,
+                    const function<void()>& run, const BenchOptions& options) {
+	/* times run(), which makes >>calls<< calls of the benchmarked method
+	 */
+	auto timeBatch = [&run](int batch) {
+		auto start = chrono::steady_clock::now();
+		for (int i = 0; i < batch; i++)
+			run();
+		return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	};
+
+	// calibrate the batch size, so that a repetition is long enough for the clock
+	int batch = 1;
+	while (timeBatch(batch) < options._min_rep_us * 1000.0 && batch < (1 << 24))
+		batch *= 2;
+
+	for (int i = 0; i < options._warmup; i++)
+		timeBatch(batch);
+
+	BenchResult result {benchmark, position, calls, {}};
+	for (int i = 0; i < options._reps; i++)
+		result._ns.push_back(timeBatch(batch) / (double(batch) * calls));
+	sort(result._ns.begin(), result._ns.end());
+	return result;
+}
+
+vector<BenchResult> runBenchmarks(const BenchOptions& options) {
+	vector<BenchResult> results;
+	string save_file = (filesystem::temp_directory_path() / "chess73_bench_board.txt").string();
+
+	for (const BenchPosition& position : BENCH_CORPUS) {
+		ChessBoard chess_board;
+		loadBenchPosition(chess_board, position);
+		bool white_to_move = chess_board._pos.sideToMove() == WHITE;
+
+		// inputs: the figures of both colors and the legal moves of the side to move
+		vector<string> white_figures = chess_board.getWhiteFigures();
+		vector<string> black_figures = chess_board.getBlackFigures();
+		vector<pair<string, bool>> figures;  // notation, is_white
+		for (const string& f : white_figures) figures.push_back({f, true});
+		for (const string& f : black_figures) figures.push_back({f, false});
+
+		MoveList legal_moves;
+		chess_board.getLegalMoves(white_to_move, legal_moves);
+		vector<string> moves;
+		for (Move m : legal_moves)
+			moves.push_back(chess_board.moveToNotation(m));
+
+		auto add = [&](const string& benchmark, int calls, const function<void()>& run) {
+			if (calls == 0 || benchmark.find(options._filter) == string::npos)
+				return;
+			results.push_back(measure(benchmark, position._name, calls, run, options));
+		};
+
+		// one benchmark per figure mechanic, called for every figure of that kind
+		typedef vector<string> (ChessBoard::*FigureMoves)(int, int, bool);
+		const pair<const char*, FigureMoves> mechanics[] = {
+			{"getKingMoves", &ChessBoard::getKingMoves},
+			{"getQueenMoves", &ChessBoard::getQueenMoves},
+			{"getRookMoves", &ChessBoard::getRookMoves},
+			{"getBishopMoves", &ChessBoard::getBishopMoves},
+			{"getKnightMoves", &ChessBoard::getKnightMoves},
+			{"getPawnMoves", &ChessBoard::getPawnMoves},
+		};
+		const char mechanic_figures[] = "KQRBNp";
+		for (int i = 0; i < 6; i++) {
+			vector<pair<string, bool>> selected;
+			for (auto& f : figures) {
+				if (f.first[0] == mechanic_figures[i])
+					selected.push_back(f);
+			}
+			FigureMoves method = mechanics[i].second;
+			add(mechanics[i].first, selected.size(), [&]() {
+				for (auto& f : selected) {
+					vector<int> rc = algebraicToVector(figureToLocation(f.first));
+					bench_sink += (chess_board.*method)(rc[0], rc[1], f.second).size();
+				}
+			});
+		}
+
+		add("getPossibleCaptures", figures.size(), [&]() {
+			for (auto& f : figures)
+				bench_sink += chess_board.getPossibleCaptures(f.second, f.first).size();
+		});
+		add("kingIsCheck", 2, [&]() {
+			bench_sink += chess_board.kingIsCheck(true) + chess_board.kingIsCheck(false);
+		});
+		add("isValidMove", moves.size(), [&]() {
+			for (const string& m : moves)
+				bench_sink += chess_board.isValidMove(m, white_to_move);
+		});
+		add("simulateMove", moves.size(), [&]() {
+			for (const string& m : moves)
+				bench_sink += chess_board.simulateMove(m, white_to_move, false);
+		});
+		add("isCheckmate", 2, [&]() {
+			bench_sink += chess_board.isCheckmate(true) + chess_board.isCheckmate(false);
+		});
+		add("saveBoard", 1, [&]() {
+			chess_board.saveBoard(save_file);
+		});
+
+		chess_board.saveBoard(save_file);
+		ChessBoard scratch_board;  // loading replaces the board, the corpus position stays untouched
+		add("loadBoard", 1, [&]() {
+			scratch_board.loadBoard(save_file);
+			bench_sink += scratch_board._pos.occupied();
+		});
+
+#ifdef USE_NNUE
+		if (NNUE.loaded()) {
+			NnueKernel best_kernel = nnue_kernel;
+			Position pos = chess_board._pos;
+			for (NnueKernel kernel : {NNUE_SCALAR, NNUE_SSE, NNUE_AVX2}) {
+				if (!nnueKernelSupported(kernel))
+					continue;
+				nnue_kernel = kernel;
+				string name = NNUE_KERNEL_NAMES[kernel];
+				nnueRefresh(pos._acc, WHITE, pos._board);
+				nnueRefresh(pos._acc, BLACK, pos._board);
+				add("nnueForward." + name, 1, [&]() {
+					bench_sink += nnueForward(pos._acc, pos.sideToMove());
+				});
+				add("nnueMakeUnmake." + name, legal_moves.size(), [&]() {
+					UndoRecord undo;
+					for (Move m : legal_moves) {
+						pos.makeMove(m, undo);
+						bench_sink += evaluate(pos);  // also refreshes after king moves
+						pos.unmakeMove(undo);
+					}
+				});
+				add("nnueRefresh." + name, 1, [&]() {
+					nnueRefresh(pos._acc, WHITE, pos._board);
+					nnueRefresh(pos._acc, BLACK, pos._board);
+					bench_sink += pos._acc._values[WHITE][0];
+				});
+			}
+			nnue_kernel = best_kernel;
+		}
+#endif
+	}
+	filesystem::remove(save_file);
+	return results;
+}
+
+string buildInfo() {
+#ifdef USE_PEXT
+	string slider_lookup = "pext";
+#else
+	string slider_lookup = "magic";
+#endif
+	string info = string("compiler ") + __VERSION__ + ", sliders " + slider_lookup;
+#ifdef USE_NNUE
+	if (NNUE.loaded())
+		info += string(", nnue kernel ") + NNUE_KERNEL_NAMES[nnue_kernel];
+#endif
+	return info;
+}
+
+void printEvalsPerSecond(const vector<BenchResult>& results) {
+	/* evaluations per second of every nnue benchmark, from the median over all positions
+	 */
+	vector<string> benchmarks;
+	for (const BenchResult& r : results) {
+		if (r._benchmark.compare(0, 4, "nnue") == 0 && find(benchmarks.begin(), benchmarks.end(), r._benchmark) == benchmarks.end())
+			benchmarks.push_back(r._benchmark);
+	}
+	if (benchmarks.empty())
+		return;
+	cout << endl << left << setw(24) << "nnue benchmark" << right << setw(16) << "evals/s" << endl;
+	for (const string& benchmark : benchmarks) {
+		double ns = 0;
+		int positions = 0;
+		for (const BenchResult& r : results) {
+			if (r._benchmark == benchmark) {
+				ns += r.percentile(50);
+				positions++;
+			}
+		}
+		cout << left << setw(24) << benchmark << right << setw(16) << fixed << setprecision(0)
+		     << 1e9 * positions / ns << endl;
+	}
+}
+
+void printResults(const vector<BenchResult>& results, const BenchOptions& options) {
+	const double percentiles[] = {10, 50, 90, 99};
+
+	if (options._format == "csv") {
+		cout << "benchmark,position,calls_per_rep,reps,min_ns,p10_ns,median_ns,p90_ns,p99_ns,mean_ns" << endl;
+		for (const BenchResult& r : results) {
+			cout << r._benchmark << "," << r._position << "," << r._calls << "," << r._ns.size()
+			     << fixed << setprecision(2) << "," << r._ns.front();
+			for (double p : percentiles)
+				cout << "," << r.percentile(p);
+			cout << "," << r.mean() << endl;
+		}
+	} else if (options._format == "json") {
+		cout << "{" << endl;
+		cout << "  \"build\": \"" << buildInfo() << "\"," << endl;
+		cout << "  \"reps\": " << options._reps << ", \"warmup\": " << options._warmup
+		     << ", \"min_rep_us\": " << options._min_rep_us << "," << endl;
+		cout << "  \"results\": [" << endl;
+		for (size_t i = 0; i < results.size(); i++) {
+			const BenchResult& r = results[i];
+			cout << fixed << setprecision(2)
+			     << "    {\"benchmark\": \"" << r._benchmark << "\", \"position\": \"" << r._position
+			     << "\", \"calls_per_rep\": " << r._calls << ", \"min_ns\": " << r._ns.front()
+			     << ", \"p10_ns\": " << r.percentile(10) << ", \"median_ns\": " << r.percentile(50)
+			     << ", \"p90_ns\": " << r.percentile(90) << ", \"p99_ns\": " << r.percentile(99)
+			     << ", \"mean_ns\": " << r.mean() << "}" << (i + 1 < results.size() ? "," : "") << endl;
+		}
+		cout << "  ]" << endl << "}" << endl;
+	} else {
+		cout << buildInfo() << ", " << options._reps << " repetitions, times in ns per call" << endl << endl;
+		cout << left << setw(24) << "benchmark" << setw(17) << "position" << right
+		     << setw(7) << "calls" << setw(11) << "min" << setw(11) << "p10" << setw(11) << "median"
+		     << setw(11) << "p90" << setw(11) << "p99" << endl;
+		for (const BenchResult& r : results) {
+			cout << left << setw(24) << r._benchmark << setw(17) << r._position << right
+			     << setw(7) << r._calls << fixed << setprecision(1) << setw(11) << r._ns.front();
+			for (double p : percentiles)
+				cout << setw(11) << r.percentile(p);
+			cout << endl;
+		}
+		printEvalsPerSecond(results);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	BenchOptions options;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (i + 1 >= argc) {
+			cout << "Missing value for " << arg << endl;
+			return 2;
+		}
+		if (arg == "--format") options._format = argv[++i];
+		else if (arg == "--reps") options._reps = max(1, atoi(argv[++i]));
+		else if (arg == "--warmup") options._warmup = max(0, atoi(argv[++i]));
+		else if (arg == "--min-rep-us") options._min_rep_us = max(1, atoi(argv[++i]));
+		else if (arg == "--filter") options._filter = argv[++i];
+		else if (arg == "--nnue") options._nnue = argv[++i];
+		else {
+			cout << "Usage: " << argv[0] << " [--format table|csv|json] [--reps <n>] [--warmup <n>]"
+			     << " [--min-rep-us <us>] [--filter <text>] [--nnue <file>|random]" << endl;
+			return 2;
+		}
+	}
+
+	try {
+		if (!options._nnue.empty()) {
+#ifdef USE_NNUE
+			if (options._nnue == "random") {
+				options._nnue = (filesystem::temp_directory_path() / "chess73_random.nnue").string();
+				writeRandomNetwork(options._nnue);
+			}
+			NNUE.load(options._nnue);
+#else
+			cout << "--nnue needs a build with -DUSE_NNUE" << endl;
+			return 2;
+#endif
+		}
+		printResults(runBenchmarks(options), options);
+	} catch (const exception& e) {
+		cout << e.what() << endl;
+		return 1;
+	}
+	return bench_sink == 0;  // never true, keeps the sink alive
+}
@@ -0,0 +1,79 @@
+#ifndef BITBOARD_HPP
+#define BITBOARD_HPP
+
+#include <cstdint>
+
+/* A bitboard is a set of squares packed into one 64 bit word. Square indices
+ * run from a1 = 0 to h8 = 63, i.e. square = 8 * row + col, which is the same
+ * (row, col) convention as rowColToAlgebraic().
+ */
+typedef uint64_t Bitboard;
+
+enum Color : uint8_t { WHITE, BLACK };
+
+enum PieceType : uint8_t { PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING, NO_PIECE_TYPE };
+
+// a piece is (color << 3) | type, so both parts can be extracted with a shift or a mask
+enum Piece : uint8_t {
+	W_PAWN = 0, W_KNIGHT, W_BISHOP, W_ROOK, W_QUEEN, W_KING,
+	NO_PIECE = 6,
+	B_PAWN = 8, B_KNIGHT, B_BISHOP, B_ROOK, B_QUEEN, B_KING
+};
+
+const int NO_SQUARE = 64;
+
+// castling rights, one bit each
+enum CastlingRight : uint8_t {
+	WHITE_OO = 1, WHITE_OOO = 2, BLACK_OO = 4, BLACK_OOO = 8,
+	WHITE_CASTLING = WHITE_OO | WHITE_OOO,
+	BLACK_CASTLING = BLACK_OO | BLACK_OOO,
+	ALL_CASTLING = WHITE_CASTLING | BLACK_CASTLING
+};
+
+const char FIGURE_CHARS[] = "pNBRQK";  // figure chars as used in the algebraic notation, indexed by PieceType
+
+constexpr Bitboard FILE_A_BB = 0x0101010101010101ULL;
+constexpr Bitboard FILE_H_BB = FILE_A_BB << 7;
+constexpr Bitboard RANK_1_BB = 0xFFULL;
+constexpr Bitboard RANK_2_BB = RANK_1_BB << 8;
+constexpr Bitboard RANK_3_BB = RANK_1_BB << 16;
+constexpr Bitboard RANK_6_BB = RANK_1_BB << 40;
+constexpr Bitboard RANK_7_BB = RANK_1_BB << 48;
+constexpr Bitboard RANK_8_BB = RANK_1_BB << 56;
+
+constexpr Color operator!(Color c) { return Color(c ^ BLACK); }
+
+constexpr Piece makePiece(Color c, PieceType t) { return Piece((c << 3) | t); }
+constexpr PieceType typeOf(Piece p) { return PieceType(p & 7); }
+constexpr Color colorOf(Piece p) { return Color(p >> 3); }
+
+constexpr int makeSquare(int row, int col) { return 8 * row + col; }
+constexpr int rowOf(int sq) { return sq >> 3; }
+constexpr int colOf(int sq) { return sq & 7; }
+
+constexpr Bitboard squareBB(int sq) { return 1ULL << sq; }
+
+inline int popCount(Bitboard b) { return __builtin_popcountll(b); }
+
+inline int lsb(Bitboard b) { return __builtin_ctzll(b); }
+
+inline int popLsb(Bitboard& b) {
+	/* returns the lowest square of b and removes it from the set
+	 */
+	int sq = lsb(b);
+	b &= b - 1;
+	return sq;
+}
+
+inline bool moreThanOne(Bitboard b) { return b & (b - 1); }
+
+// convert a figure char as used in the notation, e.g. 'N', to its PieceType
+inline PieceType charToPieceType(char figure) {
+	for (int t = PAWN; t <= KING; t++) {
+		if (FIGURE_CHARS[t] == figure)
+			return PieceType(t);
+	}
+	return NO_PIECE_TYPE;
+}
+
+#endif
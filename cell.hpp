@@ -5,13 +5,14 @@ struct Cell {
 	char _figure;
 	bool _empty;
 	bool _white;
-	string _location;
+	int _row, _col;  // location on the board, the notation string is only built on demand
 
 	Cell() {
 		_figure = ' ';
 		_empty = true;
 		_white = false;
-		_location = "";
+		_row = 0;
+		_col = 0;
 	}
 
 	Cell(int row, int col) {
@@ -28,15 +29,17 @@ struct Cell {
 	}
 
 	void setLocation(string notation) {  // sets notation through algebraic notation, e.g. Ka1 sets notation = a1
-		_location = notation;
+		vector<int> position {algebraicToVector(notation)};
+		setLocation(position[0], position[1]);
 	}
 
 	void setLocation(int row, int col) {
-		_location = rowColToAlgebraic(row, col);
+		_row = row;
+		_col = col;
 	}
 
 	string getNotation() {
-		return _figure + _location;
+		return _figure + rowColToAlgebraic(_row, _col);
 	}
 
 	char getFigure() {
@@ -1,9 +1,34 @@
+#ifndef CHESS_HPP
+#define CHESS_HPP
+
 #include "cell.hpp"
+#include "position.hpp"
+#include "movegen.hpp"
+#include "search.hpp"
+#include "book.hpp"
 #include <fstream>
+#include <iomanip>
+
+// how the game stands after the last move made with ChessBoard::makeMove()
+enum GameResult {
+	GAME_ONGOING,
+	GAME_CHECKMATE,
+	GAME_STALEMATE,
+	GAME_DRAW_50_MOVES,
+	GAME_DRAW_REPETITION,
+	GAME_TABLEBASE_WIN,  // adjudicated by the endgame tablebases
+	GAME_TABLEBASE_DRAW
+};
 
 struct ChessBoard {
-	vector<vector<Cell>> _board;
+	Position _pos;  // bitboard representation, the methods below are an adapter on top of it
+	vector<UndoRecord> _history;  // undo records of the moves made with makeMove(), most recent last
 	int _rows = 8, _columns = 8;
+	shared_ptr<TranspositionTable> _tt;  // created with the first search, kept between searches
+	size_t _hash_mb = 16;
+	int _threads = 1;  // search threads (Lazy SMP)
+	vector<shared_ptr<PawnTable>> _pawn_tables;  // one per search thread, kept between searches
+	GameResult _result = GAME_ONGOING;
 	
 	void init();
 	void position(string algebraic_move, bool white);
@@ -20,24 +45,40 @@ struct ChessBoard {
 	vector<string> getWhiteFigures();
 	vector<string> getBlackFigures();
 	bool makeMove(string notation_input, bool white_is_next);
-	Cell& getCell(string location_notation);
+	void applyMove(Move m);
+	void unmakeMove();
+	Cell getCell(string location_notation);
+	void removeFigure(string location_notation);
 	void saveBoard(string filename);
 	void loadBoard(string filename);
+	void loadFen(string fen);
+	void loadPosition(string source);
 	bool kingIsCheck(bool is_white);
 	bool isValidMove(string notation_input, bool is_white);
 	bool simulateMove(string notation_input, bool is_white, bool verbose);
+	bool leavesKingInCheck(Move m, bool is_white);
+	Move notationToMove(string notation_input);
+	string moveToNotation(Move m);
+	void getLegalMoves(bool is_white, MoveList& moves);
+	template<typename Visitor> bool visitPossibleMoves(bool is_white, Visitor&& visit);
+	template<typename Visitor> bool visitPossibleCaptures(bool is_white, Visitor&& visit);
 	bool isCheckmate(bool is_white);
+	bool isStalemate(bool is_white);
+	bool hasLegalMove(bool is_white);
+	int repetitions();
+	SearchResult search(const SearchLimits& limits, const SearchFeatures& features, bool verbose,
+	                    function<void(const SearchResult&)> on_iteration);
+	string pvToNotation(const vector<Move>& pv);
+	void printSearchInfo(const SearchResult& result);
+	bool isEmptyOrEnemy(int row, int col, bool is_white);
+	bool isEnemy(int row, int col, bool is_white);
 };
 
-// init an empty board, fill with empty cells
+// init an empty board
 void ChessBoard::init() {
-	_board = vector<vector<Cell>>();
-	for (size_t row = 0; row < _rows; row++) {
-		_board.push_back(vector<Cell>());
-		for (size_t col = 0; col < _columns; col++) {
-			_board[row].push_back(Cell(row, col));
-		}
-	}
+	_pos.clear();
+	_history.clear();
+	_result = GAME_ONGOING;
 }
 
 
@@ -51,9 +92,21 @@ void ChessBoard::position(string notation, bool is_white) {
 	char figure = notation[0];        // first char is the figure char
 	int col = notation[1] - 'a';	  // the col-char minus 'a' gives the column as an int
 	int row = notation[2] - '0' - 1;  // the row as an int
-	
-	if (_board[row][col].isEmpty() || _board[row][col].isWhite() ^ is_white) {  // if empty or different color
-		_board[row][col].placeFigure(figure, is_white);  // place/replace figure on board
+
+	PieceType type = charToPieceType(figure);
+	if (type == NO_PIECE_TYPE || !indicesValid(row, col))
+		throw runtime_error(notation + " is not a valid figure notation!");
+
+	int sq = makeSquare(row, col);
+	Color color = is_white ? WHITE : BLACK;
+	if (type == KING && _pos.pieces(color, KING))
+		throw runtime_error("There is already a King of this color on the board!");
+
+	if (isEmptyOrEnemy(row, col, is_white)) {  // if empty or different color
+		if (!_pos.isEmpty(sq))
+			_pos.removePiece(sq);  // replace enemy figure
+		_pos.putPiece(makePiece(color, type), sq);  // place figure on board
+		_pos.inferCastlingRights();
 	} else {
 		// if not empty or same color, throw error
 		throw runtime_error("A figure is already at " + to_string(row) + "|" + to_string(col) + " (row|col)!");
@@ -64,6 +117,7 @@ void ChessBoard::print(int offset = 13) {
 	/* Method to print the current board
 	 * (self-explanatory)
 	 */
+	PROFILE_SCOPE("ChessBoard::print");
 	cout << getNChars(' ', offset);
 	cout << "       a      b      c      d      e      f      g      h" << endl;
 	cout << getNChars(' ', offset);
@@ -74,9 +128,10 @@ void ChessBoard::print(int offset = 13) {
 		cout << getNChars(' ', offset);
 		cout << " " << row+1 << " |";
 		for (size_t col = 0; col < _columns; col++) {
-			cout << " " << _board[row][col].getFigure();
-			if (!_board[row][col].isEmpty()) {
-				(_board[row][col].isWhite()) ? cout << "(w)" : cout << "(k)";
+			Cell cell = getCell(rowColToAlgebraic(row, col));
+			cout << " " << cell.getFigure();
+			if (!cell.isEmpty()) {
+				(cell.isWhite()) ? cout << "(w)" : cout << "(k)";
 			} else {
 				cout << "   ";
 			}
@@ -96,36 +151,54 @@ bool ChessBoard::isCaptureable(string cell_position, bool attacker_is_white) {
 	vector<int> position {algebraicToVector(cell_position)};  // convert e.g. b2 to (1,1)
 	int row {position[0]}, col {position[1]};
 
-	// if NOT empty and DIFFERENT color (^ is the XOR operator) -> capturable, false otherwise
-	if (!_board[row][col].isEmpty() && attacker_is_white ^ _board[row][col].isWhite()) {
-		return true;
-	} else {return false;}
+	// if NOT empty and DIFFERENT color -> capturable, false otherwise
+	return isEnemy(row, col, attacker_is_white);
+}
+
+bool ChessBoard::isEmptyOrEnemy(int row, int col, bool is_white) {
+	/* true if a figure of the given color could move to the cell
+	 */
+	Piece piece = _pos.pieceOn(makeSquare(row, col));
+	return piece == NO_PIECE || (colorOf(piece) == WHITE) ^ is_white;  // XOR -> different color
+}
+
+bool ChessBoard::isEnemy(int row, int col, bool is_white) {
+	/* true if the cell holds a figure of the opposite color
+	 */
+	Piece piece = _pos.pieceOn(makeSquare(row, col));
+	return piece != NO_PIECE && (colorOf(piece) == WHITE) ^ is_white;
 }
 
 vector<string> ChessBoard::getPossibleCaptures(bool is_white, string figure_notation) {
-	/* returns a vector of strings with all possible captures of a piece
+	/* returns a vector of strings with all possible captures of a piece, the
+	 * captured figures with their cell, most valuable figure first (MVV-LVA, the
+	 * attacker is the same for all of them)
 	 */
+	PROFILE_SCOPE("ChessBoard::getPossibleCaptures");
 	vector<string> possible_moves {getPossibleMoves(figure_notation)};
 	vector<string> possible_captures;
-	string figure;
 
 	for (auto cell_pos : possible_moves) {
 		if (isCaptureable(cell_pos, is_white))
-			figure = getCell(cell_pos).getNotation();
-			possible_captures.push_back(figure);
+			possible_captures.push_back(getCell(cell_pos).getNotation());
 	}
+	auto value = [](const string& figure) { return PIECE_VALUES[charToPieceType(figure[0])]; };
+	stable_sort(possible_captures.begin(), possible_captures.end(),
+	            [&](const string& a, const string& b) { return value(a) > value(b); });
 	return possible_captures;
 }
 
 vector<string> ChessBoard::getPossibleMoves(string figure_notation) {
 	/* returns a string vector of all possible moves of a piece
 	 */
+	PROFILE_SCOPE("ChessBoard::getPossibleMoves");
 	vector<string> possible_moves;
 	int col = figure_notation[1] - 'a';
 	int row = figure_notation[2] - '0' - 1;
-	bool is_white = _board[row][col].isWhite();
+	Cell cell = getCell(rowColToAlgebraic(row, col));
+	bool is_white = cell.isWhite();
 
-	switch (_board[row][col].getFigure()) {
+	switch (cell.getFigure()) {
 		case 'K':
 			return this->getKingMoves(row, col, is_white);
 			break;
@@ -155,143 +228,36 @@ vector<string> ChessBoard::getPossibleMoves(string figure_notation) {
    ===================================================================================== */
 
 vector<string> ChessBoard::getKingMoves(int row, int col, bool is_white) {
-	vector<string> moves;
-	for (int pos_row = row-1; pos_row < row+2; pos_row++) {
-		for (int pos_col = col-1; pos_col < col+2; pos_col++) {
-			if (indicesValid(pos_row, pos_col)) {
-				if (pos_row != row || pos_col != col) {
-					if (_board[pos_row][pos_col].isWhite() ^ is_white || _board[pos_row][pos_col].isEmpty())  // XOR -> only possible if color is different, or if field is empty
-					moves.push_back(rowColToAlgebraic(pos_row, pos_col));
-				}
-			}
-		}
-	}
-	return moves;
+	// only possible if color is different, or if field is empty
+	Bitboard own = _pos.pieces(is_white ? WHITE : BLACK);
+	return squaresToAlgebraic(kingAttacks(makeSquare(row, col)) & ~own);
 }
 
 vector<string> ChessBoard::getQueenMoves(int row, int col, bool is_white) {
-	vector<string> moves = getRookMoves(row, col, is_white);
-	vector<string> bishopMoves = getBishopMoves(row, col, is_white);
-	moves.insert(moves.end(), bishopMoves.begin(), bishopMoves.end());
-	return moves;
+	Bitboard own = _pos.pieces(is_white ? WHITE : BLACK);
+	return squaresToAlgebraic(queenAttacks(makeSquare(row, col), _pos.occupied()) & ~own);
 }
 
 vector<string> ChessBoard::getRookMoves(int row, int col, bool is_white) {
-	vector<string> moves;
-	// "shoot" into all directions and detect collisions
-	for (size_t pos_row = row+1; pos_row < 8; pos_row++) {
-		if (_board[pos_row][col].isWhite() ^ is_white || _board[pos_row][col].isEmpty()) { // XOR -> only
-													// possible if color is different, or if field is empty
-			moves.push_back(rowColToAlgebraic(pos_row, col));
-			if (!_board[pos_row][col].isEmpty()) break;  // break out if enemy was encountered
-		} else {
-			break;
-		}
-	}
-	for (int pos_row = row-1; pos_row >= 0; pos_row--) {
-		if (_board[pos_row][col].isWhite() ^ is_white || _board[pos_row][col].isEmpty()) {
-			moves.push_back(rowColToAlgebraic(pos_row, col));
-			if (!_board[pos_row][col].isEmpty()) break;  // break out if enemy was encountered
-		} else {
-			break;
-		}
-	}
-	for (size_t pos_col = col+1; pos_col < 8; pos_col++) {
-		if (_board[row][pos_col].isWhite() ^ is_white || _board[row][pos_col].isEmpty()) {
-			moves.push_back(rowColToAlgebraic(row, pos_col));
-			if (!_board[row][pos_col].isEmpty()) break;  // break out if enemy was encountered
-		} else {
-			break;
-		}
-	}
-	for (int pos_col = col-1; pos_col >= 0; pos_col--) {
-		if (_board[row][pos_col].isWhite() ^ is_white || _board[row][pos_col].isEmpty()) {
-			moves.push_back(rowColToAlgebraic(row, pos_col));
-			if (!_board[row][pos_col].isEmpty()) break;  // break out if enemy was encountered
-		} else {
-			break;
-		}
-	}
-	return moves;
+	// one table lookup gives all squares up to (and including) the first collision in every direction
+	Bitboard own = _pos.pieces(is_white ? WHITE : BLACK);
+	return squaresToAlgebraic(rookAttacks(makeSquare(row, col), _pos.occupied()) & ~own);
 }
 
 vector<string> ChessBoard::getBishopMoves(int row, int col, bool is_white) {
-	vector<string> moves;
-	// "shoot" into all diagonals and detect collisions 4 for loops to iterate over each direction
-	for (size_t i = 1; i < 8; i++) {
-		if (indicesValid(row+i, col+i)) {
-			if (_board[row+i][col+i].isWhite() ^ is_white || _board[row+i][col+i].isEmpty()) {
-				moves.push_back(rowColToAlgebraic(row+i, col+i));
-				if (!_board[row+i][col+i].isEmpty()) break;  // break out if enemy was encountered
-			} else { break; }
-		} else { break; }
-	}
-	for (size_t i = 1; i < 8; i++) {
-		if (indicesValid(row-i, col-i)) {
-			if (_board[row-i][col-i].isWhite() ^ is_white || _board[row-i][col-i].isEmpty()) {
-				moves.push_back(rowColToAlgebraic(row-i, col-i));
-				if (!_board[row-i][col-i].isEmpty()) break;  // break out if enemy was encountered
-			} else { break; }
-		} else { break; }
-	}
-	for (size_t i = 1; i < 8; i++) {
-		if (indicesValid(row-i, col+i)) {
-			if (_board[row-i][col+i].isWhite() ^ is_white || _board[row-i][col+i].isEmpty()) {
-				moves.push_back(rowColToAlgebraic(row-i, col+i));
-				if (!_board[row-i][col+i].isEmpty()) break;  // break out if enemy was encountered
-			} else { break; }
-		} else { break; }
-	}
-	for (size_t i = 1; i < 8; i++) {
-		if (indicesValid(row+i, col-i)) {
-			if (_board[row+i][col-i].isWhite() ^ is_white || _board[row+i][col-i].isEmpty()) {
-				moves.push_back(rowColToAlgebraic(row+i, col-i));
-				if (!_board[row+i][col-i].isEmpty()) break;  // break out if enemy was encountered
-			} else { break; }
-		} else { break; }
-	}
-	return moves;
+	Bitboard own = _pos.pieces(is_white ? WHITE : BLACK);
+	return squaresToAlgebraic(bishopAttacks(makeSquare(row, col), _pos.occupied()) & ~own);
 }
 
 vector<string> ChessBoard::getKnightMoves(int row, int col, bool is_white) {
-	vector<string> moves;
-	for (int i {-2}; i < 3; i += 4) {  // jump 2 back/forth
-		for (int j {-1}; j < 2; j += 2) {  // jump 1 left/right
-			if (indicesValid(row+i, col+j)) {
-				if (_board[row+i][col+j].isWhite() ^ is_white || _board[row+i][col+j].isEmpty())
-					moves.push_back(rowColToAlgebraic(row+i, col+j));
-			}
-		}
-	}
-	for (int i {-2}; i < 3; i += 4) {  // jump 2 left/right
-		for (int j {-1}; j < 2; j += 2) {  // jump 1 back/forth
-			if (indicesValid(row+j, col+i)) {
-				if (_board[row+j][col+i].isWhite() ^ is_white || _board[row+j][col+i].isEmpty())
-					moves.push_back(rowColToAlgebraic(row+j, col+i));
-			}
-		}
-	}
-	return moves;
+	Bitboard own = _pos.pieces(is_white ? WHITE : BLACK);
+	return squaresToAlgebraic(knightAttacks(makeSquare(row, col)) & ~own);
 }
 
 vector<string> ChessBoard::getPawnMoves(int row, int col, bool is_white) {
-	vector<string> moves;
-	int delta_row;
-	(is_white) ? delta_row = 1 : delta_row = -1;
-	if (indicesValid(row+delta_row, col)) {
-		if (_board[row+delta_row][col].isEmpty())
-			moves.push_back(rowColToAlgebraic(row+delta_row, col));
-	}
-	if (indicesValid(row+delta_row, col+1)) {
-		if (_board[row+delta_row][col+1].isWhite() ^ is_white && !_board[row+delta_row][col+1].isEmpty())
-			moves.push_back(rowColToAlgebraic(row+delta_row, col+1));
-	}
-
-	if (indicesValid(row+delta_row, col-1)) {
-		if (_board[row+delta_row][col-1].isWhite() ^ is_white && !_board[row+delta_row][col-1].isEmpty())
-			moves.push_back(rowColToAlgebraic(row+delta_row, col-1));
-	}
-	return moves;
+	// the direction of the pawn is resolved at compile time inside pawnTargets
+	int sq = makeSquare(row, col);
+	return squaresToAlgebraic(is_white ? pawnTargets<WHITE>(_pos, sq) : pawnTargets<BLACK>(_pos, sq));
 }
 
 /* =====================================================================================
@@ -303,12 +269,10 @@ vector<string> ChessBoard::getWhiteFigures() {
 	 *  e.g. {"Bc1", "Qd1", ... }
 	 */
 	vector<string> figures;
-	for (auto row : _board) {
-		for (auto cell : row) {
-			if (cell.isWhite() && !cell.isEmpty()) {
-				figures.push_back(cell.getNotation());
-			}
-		}
+	Bitboard white_figures = _pos.pieces(WHITE);
+	while (white_figures) {  // squares in ascending order, i.e. a1, b1, ..., h8
+		int sq = popLsb(white_figures);
+		figures.push_back(FIGURE_CHARS[typeOf(_pos.pieceOn(sq))] + rowColToAlgebraic(rowOf(sq), colOf(sq)));
 	}
 	return figures;
 }
@@ -318,47 +282,75 @@ vector<string> ChessBoard::getBlackFigures() {
 	 *  e.g. {"Bc1", "Qd1", ... }
 	 */
 	vector<string> figures;
-	for (auto row : _board) {
-		for (auto cell : row) {
-			if (!cell.isWhite() && !cell.isEmpty()) {
-				figures.push_back(cell.getNotation());
-			}
-		}
+	Bitboard black_figures = _pos.pieces(BLACK);
+	while (black_figures) {
+		int sq = popLsb(black_figures);
+		figures.push_back(FIGURE_CHARS[typeOf(_pos.pieceOn(sq))] + rowColToAlgebraic(rowOf(sq), colOf(sq)));
 	}
 	return figures;
 }
 
-Cell& ChessBoard::getCell(string location_notation) {
-	/* get the reference to the cell with the specified location
+Cell ChessBoard::getCell(string location_notation) {
+	/* get a snapshot of the cell with the specified location, changes to the
+	 * board have to go through position() and removeFigure()
 	 */
-	Cell cell;
 	vector<int> position = algebraicToVector(location_notation);
-	return _board[position[0]][position[1]];
+	Cell cell(position[0], position[1]);
+	Piece piece = _pos.pieceOn(makeSquare(position[0], position[1]));
+	if (piece != NO_PIECE)
+		cell.placeFigure(FIGURE_CHARS[typeOf(piece)], colorOf(piece) == WHITE);
+	return cell;
+}
+
+void ChessBoard::removeFigure(string location_notation) {
+	/* removes the figure at the specified location, if there is one
+	 */
+	vector<int> position = algebraicToVector(location_notation);
+	int sq = makeSquare(position[0], position[1]);
+	if (!_pos.isEmpty(sq))
+		_pos.removePiece(sq);
 }
 
 bool ChessBoard::makeMove(string notation_input, bool is_white) {
 	/* checks if move if valid and if no rules are broken, and then
-	 * performs the move. Also checks for check and checkmate, respectively.
+	 * performs the move. Also checks for check and checkmate, respectively,
+	 * the end of the game is stored in _result.
 	 */
-	bool move_valid = false;
-
-	vector<string> figures;
-	(is_white) ? figures = getWhiteFigures() : figures = getBlackFigures();
+	PROFILE_SCOPE("ChessBoard::makeMove");
+	bool move_valid = isValidMove(notation_input, is_white);
 
-	move_valid = isValidMove(notation_input, is_white);
-	
 	if (move_valid) {
-		// Reference to current cell of figure
-		Cell& figure = this->getCell(figureToLocation(fullNotationToOriginalFigure(notation_input)));
-		figure.removeFigure();  // remove figure from current position
-		this->position(fullNotationToTargetFigure(notation_input), is_white);  // place figure in new position
+		applyMove(notationToMove(notation_input));
 		
 		//kingIsCheck(is_white);
 		if(kingIsCheck(!is_white)) {
 			printInfoBox("King is check!");
 			if (isCheckmate(!is_white)) {
 				printInfoBox("CHECKMATE, LOOOOSER!");
-				exit(0);
+				_result = GAME_CHECKMATE;
+			}
+		} else if (isStalemate(!is_white)) {
+			printInfoBox("STALEMATE, nobody wins!");
+			_result = GAME_STALEMATE;
+		}
+		if (_result == GAME_ONGOING && _pos._rule50 >= 100) {
+			printInfoBox("DRAW, 50 moves without a capture or a pawn move!");
+			_result = GAME_DRAW_50_MOVES;
+		}
+		if (_result == GAME_ONGOING && repetitions() >= 2) {
+			printInfoBox("DRAW, the same position occurred three times!");
+			_result = GAME_DRAW_REPETITION;
+		}
+		if (_result == GAME_ONGOING) {  // adjudication, if the position is in a loaded tablebase
+			int plies = TABLEBASES.probe(_pos);
+			if (plies == TB_DRAW) {
+				printInfoBox("DRAW, the tablebase says nobody can win!");
+				_result = GAME_TABLEBASE_DRAW;
+			} else if (plies != TB_NOT_FOUND) {
+				bool white_wins = (plies % 2 == 1) == !is_white;
+				printInfoBox(string(white_wins ? "WHITE" : "BLACK") + " WINS, the tablebase has a mate in "
+				             + to_string((plies + 1) / 2) + "!");
+				_result = GAME_TABLEBASE_WIN;
 			}
 		}
 		return true;
@@ -366,17 +358,38 @@ bool ChessBoard::makeMove(string notation_input, bool is_white) {
 	return false;
 }
 
+void ChessBoard::applyMove(Move m) {
+	/* makes a legal move without any checks or output, e.g. a move of the engine
+	 * or of a GUI. The undo record allows to take the move back with unmakeMove().
+	 */
+	UndoRecord undo;
+	_pos.makeMove(m, undo);
+	_history.push_back(undo);
+}
+
+void ChessBoard::unmakeMove() {
+	/* takes back the last move made with makeMove()
+	 */
+	PROFILE_SCOPE("ChessBoard::unmakeMove");
+	if (_history.empty())
+		throw runtime_error("There is no move to take back!");
+	_pos.unmakeMove(_history.back());
+	_history.pop_back();
+}
+
 void ChessBoard::saveBoard(string filename) {
 	/* saves board to file in a simply editable format 
 	 */
+	PROFILE_SCOPE("ChessBoard::saveBoard");
 	ofstream output_file(filename);
 	if (output_file.is_open()) {
 		for (size_t row = 7; row < _rows; row--) {  // print rows from 8 to 1 (top to bottom, 
 													// as usual in chess)
 			for (size_t col = 0; col < _columns; col++) {
-				if (!_board[row][col].isEmpty()) {
-					output_file <<  _board[row][col].getFigure();
-					(_board[row][col].isWhite()) ? output_file << "(w)" : output_file << "(k)";
+				Cell cell = getCell(rowColToAlgebraic(row, col));
+				if (!cell.isEmpty()) {
+					output_file << cell.getFigure();
+					(cell.isWhite()) ? output_file << "(w)" : output_file << "(k)";
 				} else {
 					output_file << "----";
 				}
@@ -390,8 +403,9 @@ void ChessBoard::saveBoard(string filename) {
 void ChessBoard::loadBoard(string filename) {
 	/* loads board from file in a simply editable format 
 	 */
+	PROFILE_SCOPE("ChessBoard::loadBoard");
 	ifstream input_file(filename);
-	string line, cell;
+	string line;
 	this->init();
 	int row = 7, column = 0;
 
@@ -401,20 +415,25 @@ void ChessBoard::loadBoard(string filename) {
 				throw runtime_error("Invalid size of row when loading from file!");
 			
 			column = 0;
-			for (size_t i {0}; i < 8; i++) {  // read next cell notation
-				cell = "";
-				cell += line[4*i];
-				cell += line[4*i + 1];
-				cell += line[4*i + 2];
-				cell += line[4*i + 3];
-				if (cell != "----") {  // if cell not empty
+			for (size_t i {0}; i < 8; i++) {  // read next cell notation, in place
+				const char* cell = line.data() + 4*i;
+				if (line.compare(4*i, 4, "----") != 0) {  // if cell not empty
 
+					PieceType type = charToPieceType(cell[0]);
+					if (type == NO_PIECE_TYPE)
+						throw invalid_argument("Encountered invalid figure while loading board from file!");
+
+					Color color;
 					if (cell[2] == 'w') {
-						_board[row][column].placeFigure(cell[0], true);
+						color = WHITE;
 					} else if (cell[2] == 'k') {
-						_board[row][column].placeFigure(cell[0], false);
+						color = BLACK;
 					} else { throw invalid_argument("Encountered invalid color while loading board from file!"); }
 
+					if (type == KING && _pos.pieces(color, KING))
+						throw invalid_argument("Encountered more than one King of a color while loading board from file!");
+					_pos.putPiece(makePiece(color, type), makeSquare(row, column));
+
 					// cout << "Placed " << cell << " at " << rowColToAlgebraic(row, column) << endl;
 				}
 				column++;
@@ -423,25 +442,20 @@ void ChessBoard::loadBoard(string filename) {
 		}
 	}
 	input_file.close();
+	_pos.inferCastlingRights();  // the file format has no castling information, white is to move
 }
 
 bool ChessBoard::kingIsCheck(bool is_white) {
 	/* checks if King of the specified color is in check
-	 * This is done in the following way: get all possible moves of the 
-	 * enemy's figures and try if any figure could capture the King
+	 * This is done in the following way: look up all enemy figures, that
+	 * attack the square of the King from there (one table lookup per figure type)
 	 */
-	vector<string> enemy_figures;
-	vector<string> possible_captures;
-
-	(!is_white) ? enemy_figures = getWhiteFigures() : enemy_figures = getBlackFigures();
-
-	for (auto figure : enemy_figures) {
-		possible_captures = getPossibleCaptures(!is_white, figure);
-		for (auto capture : possible_captures) {
-			if (capture[0] == 'K') {
-				return true;
-			}
-		}
+	PROFILE_SCOPE("ChessBoard::kingIsCheck");
+	Color us = is_white ? WHITE : BLACK;
+	Bitboard kings = _pos.pieces(us, KING);
+	while (kings) {
+		if (attackersTo(_pos, popLsb(kings), _pos.occupied()) & _pos.pieces(!us))
+			return true;
 	}
 	return false;
 }
@@ -452,27 +466,29 @@ bool ChessBoard::isValidMove(string notation_input, bool is_white) {
 	 *
 	 * also checks, if given move would violate any rules (e.g. king suicide)
 	 */
-	string figure_notation, move_notation, new_figure_notation;
-		
-	// e.g. if input is "Bf1b5"
-	move_notation = fullNotationToTargetPosition(notation_input);  // b5
-	figure_notation = fullNotationToOriginalFigure(notation_input);  // Bf1
-	new_figure_notation = fullNotationToTargetFigure(notation_input);  // Bb5
-
-	vector<string> figures;  // vector of all figures, e.g. {"pa2", "pb2", ...}
-	(is_white) ? figures = getWhiteFigures() : figures = getBlackFigures();
+	PROFILE_SCOPE("ChessBoard::isValidMove");
+	Move m = notationToMove(notation_input);  // e.g. "Bf1b5" -> f1 to b5
+	if (!m) {
+		printError(notation_input + " is not a valid move notation!");
+		return false;
+	}
 
-	if (find(figures.begin(), figures.end(), figure_notation) != figures.end()) {  // if figure valid
-		Cell& figure = this->getCell(figureToLocation(figure_notation));  // Reference to current cell of figure
+	Color us = is_white ? WHITE : BLACK;
+	if (us != _pos.sideToMove()) {
+		printError("It is not your turn!");
+		return false;
+	}
 
-		vector<string> possible_moves = getPossibleMoves(figure_notation);
+	Piece figure = _pos.pieceOn(m.from());
+	if (figure != NO_PIECE && colorOf(figure) == us && FIGURE_CHARS[typeOf(figure)] == notation_input[0]) {  // if figure valid
+		Bitboard targets = is_white ? pieceTargets<WHITE>(_pos, typeOf(figure), m.from())
+		                            : pieceTargets<BLACK>(_pos, typeOf(figure), m.from());
 
-		// if move valid
-		if (find(possible_moves.begin(), possible_moves.end(), move_notation) != possible_moves.end()) {
-			// check if this move violates rules
-			if (simulateMove(notation_input, is_white, false))
-				return true;
-		} else {
+		// legal moves pass, moves that the figure could make but that violate rules
+		// (e.g. king suicide, castling out of check) are rejected silently
+		if (is_white ? isLegalMove<WHITE>(_pos, m) : isLegalMove<BLACK>(_pos, m)) {
+			return true;
+		} else if (!(targets & squareBB(m.to())) && m.flag() != CASTLING) {
 			printError("Figure cannot move to that location!");
 		}
 	} else {
@@ -481,22 +497,108 @@ bool ChessBoard::isValidMove(string notation_input, bool is_white) {
 	return false;
 }
 
-bool ChessBoard::simulateMove(string notation_input, bool is_white, bool verbose=true) {
-	/* creates copy of game and checks if a given move violates certain rules, such as "King Suicide"
+Move ChessBoard::notationToMove(string notation_input) {
+	/* converts the long notation, e.g. "Bf1b5", to a Move. Returns MOVE_NONE if
+	 * the notation is malformed. The figure char is not checked here.
+	 * Castling is written as king move, e.g. "Ke1g1", a promotion has the new
+	 * figure appended, e.g. "pe7e8N" (a queen, if it is left out).
+	 */
+	PROFILE_SCOPE("ChessBoard::notationToMove");
+	if (notation_input.length() != 5 && notation_input.length() != 6)
+		return MOVE_NONE;
+
+	vector<int> from {algebraicToVector(figureToLocation(fullNotationToOriginalFigure(notation_input)))};  // f1
+	vector<int> to {algebraicToVector(fullNotationToTargetPosition(notation_input))};  // b5
+	if (!indicesValid(from[0], from[1]) || !indicesValid(to[0], to[1]))
+		return MOVE_NONE;
+
+	int from_sq = makeSquare(from[0], from[1]), to_sq = makeSquare(to[0], to[1]);
+	PieceType type = typeOf(_pos.pieceOn(from_sq));
+	bool promotes = type == PAWN && (to[0] == 0 || to[0] == 7);
+
+	if (notation_input.length() == 6 && !promotes)
+		return MOVE_NONE;
+	if (promotes) {
+		PieceType promotion = (notation_input.length() == 6) ? charToPieceType(notation_input[5]) : QUEEN;
+		if (promotion < KNIGHT || promotion > QUEEN)
+			return MOVE_NONE;
+		return Move(from_sq, to_sq, PROMOTION, promotion);
+	}
+	if (type == KING && abs(from[1] - to[1]) == 2)
+		return Move(from_sq, to_sq, CASTLING);
+	if (type == PAWN && to_sq == _pos._ep && from[1] != to[1])
+		return Move(from_sq, to_sq, EN_PASSANT);
+	return Move(from_sq, to_sq);
+}
+
+void ChessBoard::loadFen(string fen) {
+	/* loads the board from a FEN string, unlike the board files it includes the
+	 * side to move, castling rights and the en passant square
 	 */
-	ChessBoard chess_board_copy;
-	chess_board_copy._board = this->_board;
+	this->init();
+	_pos.setFen(fen);
+}
 
-	// Reference to current cell of figure
-	Cell& figure = chess_board_copy.getCell(figureToLocation(fullNotationToOriginalFigure(notation_input)));
+void ChessBoard::loadPosition(string source) {
+	/* loads a board file, or a FEN string if there is no such file
+	 */
+	if (ifstream(source).good())
+		loadBoard(source);
+	else
+		loadFen(source);
+}
 
-	figure.removeFigure();  // remove figure from current position
-	chess_board_copy.position(fullNotationToTargetFigure(notation_input), is_white);  // place figure in new position
-	
-	// printInfoBox("Simulated Board:");
-	// chess_board_copy.print();
+string ChessBoard::moveToNotation(Move m) {
+	/* converts a Move to the long notation, e.g. "Bf1b5". Must be called before
+	 * the move is made, the figure is looked up on the origin square.
+	 */
+	string notation = FIGURE_CHARS[typeOf(_pos.pieceOn(m.from()))]
+	                + rowColToAlgebraic(rowOf(m.from()), colOf(m.from()))
+	                + rowColToAlgebraic(rowOf(m.to()), colOf(m.to()));
+	if (m.flag() == PROMOTION)
+		notation += FIGURE_CHARS[m.promotion()];
+	return notation;
+}
+
+void ChessBoard::getLegalMoves(bool is_white, MoveList& moves) {
+	/* stores all legal moves of the color in >>moves<<
+	 */
+	if (is_white)
+		generateLegalMoves<WHITE>(_pos, moves);
+	else
+		generateLegalMoves<BLACK>(_pos, moves);
+}
+
+template<typename Visitor>
+bool ChessBoard::visitPossibleMoves(bool is_white, Visitor&& visit) {
+	/* calls visit(move) for every legal move of the color, without storing any
+	 * of them, e.g. to count or filter moves. The visitor returns true to stop early.
+	 */
+	if (is_white)
+		return generateLegalMoves<WHITE>(_pos, visit);
+	return generateLegalMoves<BLACK>(_pos, visit);
+}
+
+template<typename Visitor>
+bool ChessBoard::visitPossibleCaptures(bool is_white, Visitor&& visit) {
+	/* like visitPossibleMoves(), but only calls visit(move) for captures
+	 * (including en passant), quiet moves are not even generated
+	 */
+	auto captures_only = [&](Move m) { return _pos.isCapture(m) ? visit(m) : false; };
+	if (is_white)
+		return generateLegalMoves<WHITE, CAPTURES>(_pos, captures_only);
+	return generateLegalMoves<BLACK, CAPTURES>(_pos, captures_only);
+}
 
-	if(chess_board_copy.kingIsCheck(is_white)) {
+bool ChessBoard::simulateMove(string notation_input, bool is_white, bool verbose=true) {
+	/* checks if a given move violates certain rules, such as "King Suicide"
+	 */
+	PROFILE_SCOPE("ChessBoard::simulateMove");
+	Move m = notationToMove(notation_input);
+	if (!m)
+		return false;
+
+	if(leavesKingInCheck(m, is_white)) {
 		if (verbose) printInfoBox("Cannot move, your King is under 'CHECK'!");
 		return false;
 	} else {
@@ -504,23 +606,163 @@ bool ChessBoard::simulateMove(string notation_input, bool is_white, bool verbose
 	}
 }
 
+bool ChessBoard::leavesKingInCheck(Move m, bool is_white) {
+	/* makes the move in place, tests the king and takes the move back again,
+	 * no copy of the board is needed
+	 */
+	PROFILE_SCOPE("ChessBoard::leavesKingInCheck");
+	UndoRecord undo;
+	_pos.makeMove(m, undo);
+	bool check = kingIsCheck(is_white);
+	_pos.unmakeMove(undo);
+	return check;
+}
+
+bool ChessBoard::hasLegalMove(bool is_white) {
+	/* true if the color has at least one legal move. The legal move generator
+	 * stops at the first move it finds, so this is cheap.
+	 */
+	PROFILE_SCOPE("ChessBoard::hasLegalMove");
+	if (is_white)
+		return ::hasLegalMove<WHITE>(_pos);
+	return ::hasLegalMove<BLACK>(_pos);
+}
+
 bool ChessBoard::isCheckmate(bool is_white) {
-	/* Check all possible moves, if no moves result in the color not
-	 * staying in check, then the other color is the winner and
-	 * we have a checkmate!
+	/* the King is in check and no move gets him out of it, i.e. the other
+	 * color is the winner and we have a checkmate!
 	 */
+	PROFILE_SCOPE("ChessBoard::isCheckmate");
+	return kingIsCheck(is_white) && !hasLegalMove(is_white);
+}
 
-	vector<string> figures, possible_moves;
-	(is_white) ? figures = getWhiteFigures() : figures = getBlackFigures();
+bool ChessBoard::isStalemate(bool is_white) {
+	/* the King is not in check, but the color cannot make any move -> draw
+	 */
+	PROFILE_SCOPE("ChessBoard::isStalemate");
+	return !kingIsCheck(is_white) && !hasLegalMove(is_white);
+}
 
-	for (auto figure : figures) {
-		possible_moves = getPossibleMoves(figure);
-		for (auto move : possible_moves) {
-			// cout << "Checking for checkmate with move " << figure + move << endl;
-			if(simulateMove(figure + move, is_white, false)) {
-				return false;
-			}
+int ChessBoard::repetitions() {
+	/* how often the current position occurred before in the game, compared by key.
+	 * Only positions since the last capture or pawn move can repeat, and only every
+	 * second of them has the same side to move.
+	 */
+	int count = 0;
+	int n = _history.size();
+	for (int i = n - 2; i >= 0 && i >= n - _pos._rule50; i -= 2) {
+		if (_history[i]._key == _pos._key)  // key of the position before move i
+			count++;
+	}
+	return count;
+}
+
+SearchResult ChessBoard::search(const SearchLimits& limits, const SearchFeatures& features = SearchFeatures(), bool verbose = true,
+                                function<void(const SearchResult&)> on_iteration = nullptr) {
+	/* searches the best move for the side to move, within the depth, time or
+	 * node limit, on _threads threads. After every completed depth on_iteration is
+	 * called and with verbose one line is printed. The board itself is not
+	 * changed, the move still has to be made. With a book loaded into BOOK, a
+	 * book move is returned without searching.
+	 */
+	PROFILE_SCOPE("ChessBoard::search");
+	uint64_t seed = chrono::steady_clock::now().time_since_epoch().count();
+	if (Move book_move = BOOK.probe(_pos, splitMix64(seed))) {
+		SearchResult result;
+		result._best_move = book_move;
+		result._pv.push_back(book_move);
+		if (verbose)
+			cout << "book move " << moveToNotation(book_move) << endl;
+		return result;
+	}
+	if (!_tt)
+		_tt = make_shared<TranspositionTable>(_hash_mb);
+	_tt->newSearch();
+
+	vector<uint64_t> game_keys;  // for repetitions of positions of the game
+	for (const UndoRecord& undo : _history)
+		game_keys.push_back(undo._key);
+
+	// one searcher per thread, on the heap as they are too big for the stack. The
+	// helpers search until the main searcher is done, only the main one has limits.
+	atomic<bool> stop {false};
+	vector<unique_ptr<Searcher>> searchers;
+	SearchLimits helper_limits;
+	for (int id = 0; id < max(1, _threads); id++) {
+		searchers.push_back(make_unique<Searcher>(_pos, game_keys, *_tt, id ? helper_limits : limits, features, stop, id));
+		if (int(_pawn_tables.size()) <= id)
+			_pawn_tables.push_back(make_shared<PawnTable>());
+		_pawn_tables[id]->_probes = _pawn_tables[id]->_hits = 0;
+		searchers[id]->_pawns = _pawn_tables[id].get();
+	}
+
+	auto totalNodes = [&searchers](SearchResult& result) {
+		result._thread_nodes.clear();
+		result._nodes = 0;
+		for (auto& searcher : searchers) {
+			result._thread_nodes.push_back(searcher->_nodes);
+			result._nodes += searcher->_nodes;
+		}
+	};
+	if (verbose || on_iteration) {
+		searchers[0]->_report = [&](const SearchResult& result) {
+			SearchResult all_threads = result;
+			totalNodes(all_threads);
+			if (verbose) printSearchInfo(all_threads);
+			if (on_iteration) on_iteration(all_threads);
+		};
+	}
+
+	vector<thread> helpers;
+	for (size_t id = 1; id < searchers.size(); id++)
+		helpers.emplace_back([&searchers, id]() { searchers[id]->run(); });
+	SearchResult result = searchers[0]->run();
+	stop = true;
+	for (thread& helper : helpers)
+		helper.join();
+
+	totalNodes(result);
+	if (verbose && searchers.size() > 1) {
+		for (size_t id = 0; id < searchers.size(); id++)
+			cout << "thread " << id << " nodes " << result._thread_nodes[id] << endl;
+	}
+	if (verbose) {
+		uint64_t probes = 0, hits = 0;
+		for (size_t id = 0; id < searchers.size(); id++) {
+			probes += _pawn_tables[id]->_probes;
+			hits += _pawn_tables[id]->_hits;
 		}
+		if (probes)
+			cout << "pawn hash hits " << hits << " of " << probes << " (" << fixed << setprecision(1)
+			     << 100.0 * hits / probes << "%)" << endl;
+	}
+	return result;
+}
+
+string ChessBoard::pvToNotation(const vector<Move>& pv) {
+	/* the moves of a principal variation in long notation, separated by spaces
+	 */
+	string notation;
+	vector<UndoRecord> undos(pv.size());
+	for (size_t i = 0; i < pv.size(); i++) {
+		notation += (i ? " " : "") + moveToNotation(pv[i]);
+		_pos.makeMove(pv[i], undos[i]);
 	}
-	return true;
+	for (size_t i = pv.size(); i-- > 0; )
+		_pos.unmakeMove(undos[i]);
+	return notation;
+}
+
+void ChessBoard::printSearchInfo(const SearchResult& result) {
+	cout << "depth " << result._depth << " score ";
+	if (abs(result._score) >= VALUE_MATE_IN_MAX_PLY)  // mate in moves, negative if we get mated
+		cout << "mate " << mateInMoves(result._score);
+	else
+		cout << "cp " << result._score;
+	cout << " nodes " << result._nodes
+	     << " nps " << uint64_t(result._seconds > 0 ? result._nodes / result._seconds : 0)
+	     << " time " << int64_t(result._seconds * 1000) << " ms"
+	     << " pv " << pvToNotation(result._pv) << endl;
 }
+
+#endif
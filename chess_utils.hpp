@@ -1,6 +1,7 @@
 #include <vector>
 #include <algorithm>  // std::find
 #include "printing_utils.hpp"
+#include "bitboard.hpp"
 
 #ifndef VALID_FIGS
 #define VALID_FIGS
@@ -68,6 +69,20 @@ string rowColToAlgebraic(int row, int col) {
 	return notation;
 }
 
+// convert a set of squares to their algebraic positions, e.g. {"b3", "c4"}
+vector<string> squaresToAlgebraic(Bitboard squares) {
+	/* Takes a bitboard and returns the algebraic positions of all its squares
+	 * in ascending order (a1, b1, ..., h8)
+	 */
+	vector<string> notations;
+	notations.reserve(popCount(squares));
+	while (squares) {
+		int sq = popLsb(squares);
+		notations.push_back(rowColToAlgebraic(rowOf(sq), colOf(sq)));
+	}
+	return notations;
+}
+
 // convert e.g. "b3" to vector (2,1)
 vector<int> algebraicToVector(string notation) {
 	/* Conerts an algebraic position to a vector with the coordinates, e.g.
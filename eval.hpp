@@ -0,0 +1,86 @@
+#ifndef EVAL_HPP
+#define EVAL_HPP
+
+#include "pawns.hpp"
+#include <algorithm>
+#include <cassert>
+
+/* Static evaluation in centipawns, from the point of view of the side to move
+ * (negamax convention): positive means the side to move is better.
+ *
+ * Material and piece-square tables, tapered between a middlegame and an endgame
+ * score by the phase of the game (see psqt.hpp). Both scores and the phase are
+ * kept up to date by Position while moves are made and unmade, so evaluating a
+ * node costs a few arithmetic operations and never scans the board. The pawn
+ * structure terms come from the pawn hash table of the searching thread, see
+ * pawns.hpp. Compiled with -DDEBUG_EVAL every evaluation is checked against a
+ * full recomputation.
+ *
+ * Compiled with -DUSE_NNUE and a network loaded into NNUE, the network evaluates
+ * instead, see nnue.hpp.
+ */
+// indexed by PieceType, for exchanges and move ordering: the middlegame material of
+// psqt.hpp, so that SEE and the ordering value pieces like the evaluation does
+const int (&PIECE_VALUES)[6] = PIECE_VALUES_MG;
+
+inline int materialOf(const Position& pos, Color c) {
+	int material = 0;
+	for (int t = PAWN; t < KING; t++)
+		material += PIECE_VALUES[t] * popCount(pos.pieces(c, PieceType(t)));
+	return material;
+}
+
+inline int taper(PsqScore score, int phase) {
+	/* blends the middlegame and the endgame score, phase PHASE_MAX is pure middlegame
+	 */
+	phase = std::min(phase, PHASE_MAX);  // e.g. after promotions
+	return (score._mg * phase + score._eg * (PHASE_MAX - phase)) / PHASE_MAX;
+}
+
+inline PsqScore operator+(PsqScore a, PsqScore b) { return PsqScore {int16_t(a._mg + b._mg), int16_t(a._eg + b._eg)}; }
+
+inline int evaluateFull(const Position& pos) {
+	/* the same as evaluate(), but computed from scratch by scanning the board
+	 */
+	int score = taper(pos.computePsq() + evaluatePawns(pos), pos.computePhase());
+	return pos.sideToMove() == WHITE ? score : -score;
+}
+
+#ifdef USE_NNUE
+inline int evaluateNnue(const Position& pos) {
+	for (Color c : {WHITE, BLACK}) {
+		if (!pos._acc._valid[c])
+			nnueRefresh(pos._acc, c, pos._board);
+	}
+#ifdef DEBUG_EVAL
+	NnueAccumulator full;
+	for (Color c : {WHITE, BLACK}) {
+		nnueRefresh(full, c, pos._board);
+		assert(memcmp(full._values[c], pos._acc._values[c], sizeof(full._values[c])) == 0);
+	}
+#endif
+	return nnueForward(pos._acc, pos.sideToMove());
+}
+#endif
+
+inline int evaluate(const Position& pos, PawnTable* pawn_table = nullptr) {
+	/* without a pawn table the pawn structure is evaluated from scratch
+	 */
+#ifdef DEBUG_EVAL
+	assert(pos._psq._mg == pos.computePsq()._mg && pos._psq._eg == pos.computePsq()._eg);
+	assert(pos._phase == pos.computePhase());
+	assert(pos._pawn_key == pos.computePawnKey());
+#endif
+#ifdef USE_NNUE
+	if (NNUE.loaded())
+		return evaluateNnue(pos);
+#endif
+	PsqScore pawns = pawn_table ? pawn_table->probe(pos) : evaluatePawns(pos);
+#ifdef DEBUG_EVAL
+	assert(pawns._mg == evaluatePawns(pos)._mg && pawns._eg == evaluatePawns(pos)._eg);
+#endif
+	int score = taper(pos._psq + pawns, pos._phase);
+	return pos.sideToMove() == WHITE ? score : -score;
+}
+
+#endif
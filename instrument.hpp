@@ -0,0 +1,267 @@
+#ifndef INSTRUMENT_HPP
+#define INSTRUMENT_HPP
+
+#include <iostream>
+#include <string>
+
+/* Hot path instrumentation, only compiled in with -DINSTRUMENT:
+ *   PROFILE_SCOPE("name")   at the top of a function counts its calls, the cycles
+ *                           spent inside (rdtsc, nested calls included) and the heap
+ *                           allocations made by it, and records a trace event
+ *                           while a trace is running
+ *   printProfile()          table of all counters, most expensive first
+ *   resetProfile()
+ *   startTrace()            starts recording trace events (e.g. for a single move)
+ *   stopTrace(filename)     writes the events in the Chrome trace event format, to
+ *                           be opened in chrome://tracing or https://ui.perfetto.dev
+ * Without INSTRUMENT, PROFILE_SCOPE expands to nothing and the functions do nothing,
+ * so the instrumented code runs at full speed.
+ */
+
+#ifdef INSTRUMENT
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <x86intrin.h>  // __rdtsc
+
+// heap allocations of the current thread, counted by the replaced operators new below,
+// all variants, so that the aligned types (e.g. the hash tables) are counted as well
+thread_local uint64_t profile_allocs = 0;
+thread_local uint64_t profile_alloc_bytes = 0;
+
+inline void* profileAlloc(size_t size, size_t alignment) noexcept {
+	profile_allocs++;
+	profile_alloc_bytes += size;
+	size = size ? size : 1;
+	if (alignment <= alignof(std::max_align_t))
+		return malloc(size);
+	return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);  // a multiple of the alignment
+}
+
+// not inlined: gcc would otherwise see free() called on the result of operator new
+__attribute__((noinline)) void profileFree(void* p) noexcept { free(p); }
+
+void* operator new(size_t size) {
+	if (void* p = profileAlloc(size, 0))
+		return p;
+	throw std::bad_alloc();
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+	if (void* p = profileAlloc(size, size_t(alignment)))
+		return p;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new[](size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return profileAlloc(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return profileAlloc(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return profileAlloc(size, size_t(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return profileAlloc(size, size_t(alignment)); }
+
+void operator delete(void* p) noexcept { profileFree(p); }
+void operator delete[](void* p) noexcept { profileFree(p); }
+void operator delete(void* p, size_t) noexcept { profileFree(p); }
+void operator delete[](void* p, size_t) noexcept { profileFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { profileFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { profileFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { profileFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { profileFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { profileFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { profileFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { profileFree(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { profileFree(p); }
+
+// counters of one PROFILE_SCOPE, a static object at the call site
+struct ProfileSite {
+	const char* _name;
+	std::atomic<uint64_t> _calls {0};
+	std::atomic<uint64_t> _cycles {0};
+	std::atomic<uint64_t> _allocs {0};
+	std::atomic<uint64_t> _alloc_bytes {0};
+
+	ProfileSite(const char* name);
+};
+
+struct ProfileRegistry {
+	std::mutex _mutex;
+	std::vector<ProfileSite*> _sites;
+};
+
+inline ProfileRegistry& profileRegistry() {
+	static ProfileRegistry registry;
+	return registry;
+}
+
+ProfileSite::ProfileSite(const char* name) : _name(name) {
+	// registration happens inside the scope of the caller, its allocation is not counted there
+	uint64_t allocs = profile_allocs, bytes = profile_alloc_bytes;
+	ProfileRegistry& registry = profileRegistry();
+	std::lock_guard<std::mutex> lock(registry._mutex);
+	registry._sites.push_back(this);
+	profile_allocs = allocs;
+	profile_alloc_bytes = bytes;
+}
+
+struct TraceEvent {
+	const char* _name;
+	double _begin_us;
+	double _duration_us;
+	int _thread;
+};
+
+struct TraceRecorder {
+	static const size_t MAX_EVENTS = 1 << 20;  // reserved up front, so recording does not allocate
+	std::atomic<bool> _active {false};
+	std::mutex _mutex;
+	std::vector<TraceEvent> _events;
+	std::chrono::steady_clock::time_point _start;
+
+	double now() const { return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - _start).count(); }
+};
+
+inline TraceRecorder& traceRecorder() {
+	static TraceRecorder recorder;
+	return recorder;
+}
+
+inline int traceThreadId() {
+	static std::atomic<int> next_id {0};
+	thread_local int id = next_id++;
+	return id;
+}
+
+// measures one call of a PROFILE_SCOPE, from construction to destruction
+struct ProfileScope {
+	ProfileSite& _site;
+	uint64_t _start_cycles;
+	uint64_t _start_allocs;
+	uint64_t _start_bytes;
+	double _start_us;
+
+	ProfileScope(ProfileSite& site) : _site(site) {
+		_start_us = traceRecorder()._active.load(std::memory_order_relaxed) ? traceRecorder().now() : -1;
+		_start_allocs = profile_allocs;
+		_start_bytes = profile_alloc_bytes;
+		_start_cycles = __rdtsc();
+	}
+
+	~ProfileScope() {
+		uint64_t cycles = __rdtsc() - _start_cycles;
+		_site._calls.fetch_add(1, std::memory_order_relaxed);
+		_site._cycles.fetch_add(cycles, std::memory_order_relaxed);
+		_site._allocs.fetch_add(profile_allocs - _start_allocs, std::memory_order_relaxed);
+		_site._alloc_bytes.fetch_add(profile_alloc_bytes - _start_bytes, std::memory_order_relaxed);
+
+		TraceRecorder& recorder = traceRecorder();
+		if (_start_us >= 0 && recorder._active.load(std::memory_order_relaxed)) {
+			double end_us = recorder.now();
+			std::lock_guard<std::mutex> lock(recorder._mutex);
+			if (recorder._events.size() < TraceRecorder::MAX_EVENTS)
+				recorder._events.push_back({_site._name, _start_us, end_us - _start_us, traceThreadId()});
+		}
+	}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+	static ProfileSite PROFILE_CONCAT(profile_site_, __LINE__)(name); \
+	ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_site_, __LINE__))
+
+inline void printProfile(std::ostream& out = std::cout) {
+	/* sites with the same name (e.g. the instantiations of a template) are summed up
+	 */
+	struct Totals { uint64_t _calls = 0, _cycles = 0, _allocs = 0, _alloc_bytes = 0; };
+	std::map<std::string, Totals> totals;
+	{
+		ProfileRegistry& registry = profileRegistry();
+		std::lock_guard<std::mutex> lock(registry._mutex);
+		for (ProfileSite* site : registry._sites) {
+			Totals& t = totals[site->_name];
+			t._calls += site->_calls;
+			t._cycles += site->_cycles;
+			t._allocs += site->_allocs;
+			t._alloc_bytes += site->_alloc_bytes;
+		}
+	}
+	std::vector<std::pair<std::string, Totals>> rows(totals.begin(), totals.end());
+	std::sort(rows.begin(), rows.end(), [](auto& a, auto& b) { return a.second._cycles > b.second._cycles; });
+
+	out << std::left << std::setw(28) << "function" << std::right << std::setw(12) << "calls"
+	    << std::setw(14) << "Mcycles" << std::setw(14) << "cycles/call" << std::setw(13) << "allocs/call"
+	    << std::setw(13) << "bytes/call" << std::endl;
+	for (auto& [name, t] : rows) {
+		double calls = t._calls ? double(t._calls) : 1.0;
+		out << std::left << std::setw(28) << name << std::right << std::setw(12) << t._calls
+		    << std::fixed << std::setprecision(2) << std::setw(14) << t._cycles / 1e6
+		    << std::setprecision(0) << std::setw(14) << t._cycles / calls
+		    << std::setprecision(2) << std::setw(13) << t._allocs / calls
+		    << std::setprecision(0) << std::setw(13) << t._alloc_bytes / calls << std::endl;
+	}
+	out << "(cycles include nested calls)" << std::endl;
+}
+
+inline void resetProfile() {
+	ProfileRegistry& registry = profileRegistry();
+	std::lock_guard<std::mutex> lock(registry._mutex);
+	for (ProfileSite* site : registry._sites)
+		site->_calls = site->_cycles = site->_allocs = site->_alloc_bytes = 0;
+}
+
+inline bool startTrace() {
+	TraceRecorder& recorder = traceRecorder();
+	std::lock_guard<std::mutex> lock(recorder._mutex);
+	recorder._events.clear();
+	recorder._events.reserve(TraceRecorder::MAX_EVENTS);
+	recorder._start = std::chrono::steady_clock::now();
+	recorder._active = true;
+	return true;
+}
+
+inline bool traceActive() { return traceRecorder()._active; }
+
+inline void stopTrace(const std::string& filename) {
+	TraceRecorder& recorder = traceRecorder();
+	recorder._active = false;
+	std::lock_guard<std::mutex> lock(recorder._mutex);
+
+	std::ofstream out(filename);
+	out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [" << std::endl;
+	out << std::fixed << std::setprecision(3);
+	for (size_t i = 0; i < recorder._events.size(); i++) {
+		const TraceEvent& e = recorder._events[i];
+		out << "{\"name\": \"" << e._name << "\", \"cat\": \"chess\", \"ph\": \"X\", \"ts\": " << e._begin_us
+		    << ", \"dur\": " << e._duration_us << ", \"pid\": 1, \"tid\": " << e._thread << "}"
+		    << (i + 1 < recorder._events.size() ? "," : "") << std::endl;
+	}
+	out << "]}" << std::endl;
+	std::cout << "Wrote " << recorder._events.size() << " trace events to " << filename << std::endl;
+}
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+inline void printProfile(std::ostream& out = std::cout) {
+	out << "Instrumentation is disabled, build with -DINSTRUMENT!" << std::endl;
+}
+inline void resetProfile() {}
+inline bool startTrace() {
+	std::cout << "Instrumentation is disabled, build with -DINSTRUMENT!" << std::endl;
+	return false;
+}
+inline bool traceActive() { return false; }
+inline void stopTrace(const std::string&) {}
+
+#endif
+
+#endif
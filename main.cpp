@@ -1,5 +1,13 @@
 
 #include "chess.hpp"
+#include "perft.hpp"
+#include "analysis.hpp"
+#include "uci.hpp"
+#include "ponder.hpp"
+#include "tablebase.hpp"
+#include "mate.hpp"
+#include "packed.hpp"
+#include "pgn.hpp"
 
 /* First of, I am sorry, if I misunderstood the goals of this exercise
  * I hope that this is not much more, than was asked for
@@ -13,16 +21,48 @@
  *	all possible moves of the specified figure at >>cell_position<< to capture
  *	an enemy figure, which was the functionality that was asked for in the
  *	exercise description.
+ *
+ * Started with a subcommand, the program runs a tool instead of the game:
+ *   main perft ...     move generator benchmark, see perftMain() in perft.hpp
+ *   main search ...    searches a position, see analysisMain() in analysis.hpp
+ *   main uci           speaks UCI for chess GUIs (also "uci" as the first input),
+ *                      see uci.hpp
+ *   main tbgen ...     generates endgame tablebases, see tablebaseMain() in
+ *                      tablebase.hpp
+ *   main mate <N> ...  looks for a mate in N moves, see mateMain() in mate.hpp
+ *   main packed ...    converts and reads files of packed positions, see
+ *                      packedMain() in packed.hpp
+ *   main pgn ...       replays the games of a PGN file, see pgnMain() in pgn.hpp
+ *
+ * In the game, "go" lets the engine make the move of the side to move, and
+ * "ponder" switches pondering on and off: the engine then thinks while waiting
+ * for the input, see ponder.hpp. "fen" prints the position as FEN string.
  */
 
 using namespace std;
 
-int main() {
+int main(int argc, char* argv[]) {
+
+	if (argc > 1 && string(argv[1]) == "perft")
+		return perftMain(argc, argv);
+	if (argc > 1 && string(argv[1]) == "search")
+		return analysisMain(argc, argv);
+	if (argc > 1 && string(argv[1]) == "uci")
+		return uciMain();
+	if (argc > 1 && string(argv[1]) == "tbgen")
+		return tablebaseMain(argc, argv);
+	if (argc > 1 && string(argv[1]) == "mate")
+		return mateMain(argc, argv);
+	if (argc > 1 && string(argv[1]) == "packed")
+		return packedMain(argc, argv);
+	if (argc > 1 && string(argv[1]) == "pgn")
+		return pgnMain(argc, argv);
 	
 	bool place_figures = true;
 	bool take_turns = false;
 	bool white_is_next = true;
 	bool load_from_file = true;  // if false, place figures manually
+	bool ponder = false;  // search in the background while waiting for the input
 
 	string algebraic_move;
 	bool color;  // 1 is white, 0 is black
@@ -31,6 +71,18 @@ int main() {
 	
 	ChessBoard chess_board;
 	chess_board.init();
+	// endgame tablebases adjudicate the game, if they were generated with "main tbgen tablebases"
+	struct stat tablebase_dir;
+	if (stat("tablebases", &tablebase_dir) == 0) {
+		try {
+			vector<string> errors;
+			TABLEBASES.loadDirectory("tablebases", errors);
+			for (const string& error : errors)
+				cout << error << endl;
+		} catch (const exception& e) {
+			cout << e.what() << endl;
+		}
+	}
 
 	// place figures manually
 	if(!load_from_file) {
@@ -72,14 +124,69 @@ int main() {
 	}
 
 	// Main loop, consecutively lets white and black make a move
+	Ponderer ponderer(chess_board);
 	while(take_turns) {
 		(white_is_next) ? cout << " > White, make move: " : cout << " > Black, make move: ";
-		cin >> algebraic_move;
+		if (ponder)
+			ponderer.start();
+		bool input = bool(cin >> algebraic_move);
+		int64_t pondered_ms = ponderer.stop();  // the board is ours again
+		if (!input)  // end of input
+			break;
+		if (algebraic_move == "uci") {  // a GUI started the program
+			cin.ignore();  // the rest of the line
+			return uciMain("uci");
+		}
+
+		if (algebraic_move == "ponder") {
+			ponder = !ponder;
+			cout << "Pondering " << (ponder ? "on" : "off") << endl;
+			continue;
+		}
+
+		if (algebraic_move == "go") {  // the engine moves, one second of thinking
+			SearchLimits limits;
+			limits._movetime_ms = 1000;
+			Move best_move = MOVE_NONE;
+			if (pondered_ms && ponderer._key == chess_board._pos._key) {  // the thinking is partly done
+				cout << " > Pondered " << pondered_ms << " ms, depth " << ponderer._result._depth << endl;
+				if (pondered_ms >= limits._movetime_ms)
+					best_move = ponderer._result._best_move;
+				limits._movetime_ms = max<int64_t>(1, limits._movetime_ms - pondered_ms);
+			}
+			if (!best_move)
+				best_move = chess_board.search(limits, SearchFeatures(), true)._best_move;
+			if (!best_move)
+				continue;
+			algebraic_move = chess_board.moveToNotation(best_move);
+			cout << " > Engine plays " << algebraic_move << endl;
+		}
+
+		if (algebraic_move == "fen") {
+			cout << chess_board._pos.fen() << endl;
+			continue;
+		}
+
+		// instrumentation commands, only active in builds with -DINSTRUMENT
+		if (algebraic_move == "profile") {  // print the call counters and timers so far
+			printProfile();
+			continue;
+		}
+		if (algebraic_move == "trace") {  // record a Chrome trace of the next move
+			if (startTrace())
+				cout << "Tracing the next move..." << endl;
+			continue;
+		}
+
 		if (chess_board.makeMove(algebraic_move, white_is_next))  // make move and check if move was valid
 																  // if not, while loop enters with same
 																  // value for white_is_next
 			white_is_next = !white_is_next;
+		if (traceActive())
+			stopTrace("chess73_trace.json");
 		chess_board.print();
+		if (chess_board._result != GAME_ONGOING)
+			return 0;
 	}
 
 	return 1;
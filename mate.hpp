@@ -0,0 +1,317 @@
+#ifndef MATE_HPP
+#define MATE_HPP
+
+#include "chess.hpp"
+
+/* Mate solver, finds the shortest forced mate of the side to move:
+ *   main mate <N> [<FEN> | <board file>] [options]   default is mate_in_3.txt
+ * options:
+ *   --hash <MB>     size of the proof table, default 64
+ *   --nodes <n>     gives up after this many nodes
+ *   --compare       searches the position with the alpha-beta search as well
+ *
+ * Depth-first proof-number search (df-pn): a position of the attacker is proven
+ * as soon as one move is proven, a position of the defender needs all replies
+ * proven. The proof number of a node counts the leaves that still have to be
+ * proven, the disproof number those that have to be disproven, and the search
+ * always expands the most proving node, i.e. it follows the replies that are the
+ * easiest to refute. In mating attacks with few defending moves this finds the
+ * proof after a tiny fraction of the nodes alpha-beta needs, which has to look at
+ * every move to the full depth. The proof and disproof numbers are kept in a
+ * table keyed by the position and the number of attacker moves left.
+ *
+ * Checking moves are tried first, and with one move left only checks are tried,
+ * no other move can mate. Mates in 1, 2, ... N moves are searched one after the
+ * other, so the mate found is the shortest.
+ */
+
+const uint32_t PN_INFINITE = 1u << 30;
+
+struct MateEntry {
+	uint64_t _key;  // position key mixed with the moves left
+	uint32_t _pn;
+	uint32_t _dn;
+};
+
+struct MateSolver {
+	Position _pos;
+	Color _attacker;
+	vector<MateEntry> _table;
+	uint64_t _nodes = 0;
+	uint64_t _max_nodes = 0;  // 0 means no limit
+
+	MateSolver(const Position& pos, size_t megabytes);
+	static uint64_t entryKey(uint64_t key, int moves_left) { return key ^ (0x9E3779B97F4A7C15ULL * (moves_left + 1)); }
+	void lookup(uint64_t key, uint32_t& pn, uint32_t& dn) const;
+	void store(uint64_t key, uint32_t pn, uint32_t dn);
+	void mid(uint32_t pn_threshold, uint32_t dn_threshold, int moves_left);
+	bool proven(int moves_left);
+	bool solve(int max_moves, int& mate_in);
+	void mateLine(int moves_left, vector<Move>& line);
+	bool limitReached() const { return _max_nodes && _nodes >= _max_nodes; }
+};
+
+MateSolver::MateSolver(const Position& pos, size_t megabytes) : _pos(pos), _attacker(pos.sideToMove()) {
+	size_t entries = 2;  // buckets of two
+	while (entries * 2 * sizeof(MateEntry) <= megabytes * 1024 * 1024)
+		entries *= 2;
+	_table.assign(entries, MateEntry {0, 0, 0});
+}
+
+void MateSolver::lookup(uint64_t key, uint32_t& pn, uint32_t& dn) const {
+	/* unknown positions start with proof and disproof number 1
+	 */
+	const MateEntry* bucket = &_table[key & (_table.size() - 2)];
+	for (int i = 0; i < 2; i++) {
+		if (bucket[i]._key == key) {
+			pn = bucket[i]._pn;
+			dn = bucket[i]._dn;
+			return;
+		}
+	}
+	pn = dn = 1;
+}
+
+void MateSolver::store(uint64_t key, uint32_t pn, uint32_t dn) {
+	/* buckets of two entries: the entry of the position is updated, otherwise an
+	 * empty or unsolved entry is replaced. A solved entry (pn or dn 0) is only
+	 * replaced if both are solved, as the subtree below it would be searched again.
+	 */
+	MateEntry* bucket = &_table[key & (_table.size() - 2)];
+	auto solved = [](const MateEntry& e) { return e._key && (e._pn == 0 || e._dn == 0); };
+	MateEntry* replace;
+	if (bucket[0]._key == key)
+		replace = &bucket[0];
+	else if (bucket[1]._key == key)
+		replace = &bucket[1];
+	else if (!solved(bucket[0]) && (solved(bucket[1]) || pn == 0 || dn == 0))
+		replace = &bucket[0];  // solved entries go to the first entry
+	else
+		replace = &bucket[1];
+	*replace = MateEntry {key, pn, dn};
+}
+
+inline uint32_t pnAdd(uint32_t a, uint32_t b) { return min(PN_INFINITE, a + b); }
+
+void MateSolver::mid(uint32_t pn_threshold, uint32_t dn_threshold, int moves_left) {
+	/* expands the position until its proof number reaches >>pn_threshold<< or its
+	 * disproof number >>dn_threshold<<, the result is in the table
+	 */
+	_nodes++;
+	bool attacker = _pos.sideToMove() == _attacker;
+	uint64_t key = entryKey(_pos._key, moves_left);
+	MoveList moves;
+	generateMoves(_pos, moves);
+
+	if (moves.empty()) {  // mate or stalemate
+		bool mated = !attacker && inCheck(_pos);
+		store(key, mated ? 0 : PN_INFINITE, mated ? PN_INFINITE : 0);
+		return;
+	}
+	if (moves_left == 0) {
+		store(key, PN_INFINITE, 0);  // no move left to mate, the defender escaped
+		return;
+	}
+
+	// the children, checks first for the attacker. With one move left the mate
+	// can only be a check, the other moves are left out.
+	Move children[MAX_MOVES];
+	uint64_t child_keys[MAX_MOVES];
+	int child_moves_left = attacker ? moves_left - 1 : moves_left;
+	int n = 0, checks = 0;
+	for (Move m : moves) {
+		UndoRecord undo;
+		_pos.makeMove(m, undo);
+		bool check = inCheck(_pos);
+		uint64_t child_key = entryKey(_pos._key, child_moves_left);
+		_pos.unmakeMove(undo);
+		if (attacker && !check && moves_left == 1)
+			continue;
+		int i = n++;
+		if (attacker && check) {  // move the first quiet move behind the checks
+			children[i] = children[checks];
+			child_keys[i] = child_keys[checks];
+			i = checks++;
+		}
+		children[i] = m;
+		child_keys[i] = child_key;
+	}
+	if (n == 0) {
+		store(key, PN_INFINITE, 0);
+		return;
+	}
+
+	while (!limitReached()) {
+		// the proof numbers of the node, and the child to expand: for the attacker
+		// the one with the smallest proof number, for the defender the one with the
+		// smallest disproof number (ties go to the first, so checks come first)
+		uint32_t pn = attacker ? PN_INFINITE : 0, dn = attacker ? 0 : PN_INFINITE;
+		uint32_t best = PN_INFINITE, second = PN_INFINITE, best_pn = 0, best_dn = 0;
+		int best_child = 0;
+		for (int i = 0; i < n; i++) {
+			uint32_t child_pn, child_dn;
+			lookup(child_keys[i], child_pn, child_dn);
+			uint32_t value = attacker ? child_pn : child_dn;
+			if (attacker) {
+				pn = min(pn, child_pn);
+				dn = pnAdd(dn, child_dn);
+			} else {
+				pn = pnAdd(pn, child_pn);
+				dn = min(dn, child_dn);
+			}
+			if (value < best) {
+				second = best;
+				best = value;
+				best_child = i;
+				best_pn = child_pn;
+				best_dn = child_dn;
+			} else if (value < second) {
+				second = value;
+			}
+		}
+		if (pn >= pn_threshold || dn >= dn_threshold) {
+			store(key, pn, dn);
+			return;
+		}
+
+		uint32_t child_pn_threshold, child_dn_threshold;
+		if (attacker) {
+			child_pn_threshold = min(pn_threshold, pnAdd(second, 1));
+			child_dn_threshold = min<uint64_t>(PN_INFINITE, uint64_t(dn_threshold) - dn + best_dn);
+		} else {
+			child_pn_threshold = min<uint64_t>(PN_INFINITE, uint64_t(pn_threshold) - pn + best_pn);
+			child_dn_threshold = min(dn_threshold, pnAdd(second, 1));
+		}
+		UndoRecord undo;
+		_pos.makeMove(children[best_child], undo);
+		mid(child_pn_threshold, child_dn_threshold, child_moves_left);
+		_pos.unmakeMove(undo);
+	}
+}
+
+bool MateSolver::proven(int moves_left) {
+	/* true if the attacker mates from the current position within >>moves_left<<
+	 * moves (of the attacker)
+	 */
+	mid(PN_INFINITE, PN_INFINITE, moves_left);
+	uint32_t pn, dn;
+	lookup(entryKey(_pos._key, moves_left), pn, dn);
+	return pn == 0;
+}
+
+bool MateSolver::solve(int max_moves, int& mate_in) {
+	/* true if there is a mate in >>mate_in<< <= >>max_moves<< moves; without, or with
+	 * the node limit reached, mate_in is the first length that was not proven
+	 */
+	for (mate_in = 1; mate_in <= max_moves; mate_in++) {
+		if (proven(mate_in))
+			return true;
+		if (limitReached())
+			return false;
+	}
+	return false;
+}
+
+void MateSolver::mateLine(int moves_left, vector<Move>& line) {
+	/* a mating line of a proven position: the attacker plays a shortest mate, the
+	 * defender the reply that delays it longest
+	 */
+	MoveList moves;
+	generateMoves(_pos, moves);
+	if (moves.empty())
+		return;
+	bool attacker = _pos.sideToMove() == _attacker;
+	int limit = attacker ? moves_left - 1 : moves_left;  // attacker moves left after the move
+	Move best = MOVE_NONE;
+	int best_length = attacker ? limit + 1 : -1;
+	for (Move m : moves) {
+		UndoRecord undo;
+		_pos.makeMove(m, undo);
+		int length = attacker ? 0 : 1;  // the shortest mate after the move
+		while (length <= limit && !proven(length))
+			length++;
+		_pos.unmakeMove(undo);
+		if (length <= limit && (attacker ? length < best_length : length > best_length)) {
+			best = m;
+			best_length = length;
+		}
+	}
+	if (!best)
+		return;
+	line.push_back(best);
+	UndoRecord undo;
+	_pos.makeMove(best, undo);
+	mateLine(best_length, line);
+	_pos.unmakeMove(undo);
+}
+
+int mateMain(int argc, char* argv[]) {
+	size_t hash_mb = 64;
+	uint64_t max_nodes = 0;
+	bool compare = false;
+	int max_moves = 0;
+	string source;
+	for (int i = 2; i < argc; i++) {
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--hash" && has_value) {
+			hash_mb = max(1, atoi(argv[++i]));
+		} else if (arg == "--nodes" && has_value) {
+			max_nodes = strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--compare") {
+			compare = true;
+		} else if (arg.substr(0, 2) == "--") {
+			cout << "Unknown option " << arg << endl;
+			return 2;
+		} else if (!max_moves) {
+			max_moves = atoi(arg.c_str());
+		} else {
+			source += (source.empty() ? "" : " ") + arg;  // an unquoted FEN arrives as several arguments
+		}
+	}
+	if (max_moves <= 0) {
+		cout << "Usage: " << argv[0] << " mate <N> [<FEN> | <board file>] [--hash <MB>] [--nodes <n>] [--compare]" << endl;
+		return 2;
+	}
+
+	ChessBoard chess_board;
+	try {
+		chess_board.loadPosition(source.empty() ? "mate_in_3.txt" : source);
+	} catch (const exception& e) {
+		cout << e.what() << endl;
+		return 2;
+	}
+	chess_board.print();
+
+	MateSolver solver(chess_board._pos, hash_mb);
+	solver._max_nodes = max_nodes;
+	auto start = chrono::steady_clock::now();
+	int mate_in;
+	bool found = solver.solve(max_moves, mate_in);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	vector<Move> line;
+	if (found)
+		solver.mateLine(mate_in, line);
+
+	if (found)
+		cout << "mate in " << mate_in << ": " << chess_board.pvToNotation(line) << endl;
+	else if (solver.limitReached())
+		cout << "node limit reached, no mate in " << mate_in - 1 << " or less" << endl;
+	else
+		cout << "no mate in " << max_moves << " or less" << endl;
+	cout << "nodes " << solver._nodes << " time " << fixed << setprecision(1) << seconds * 1000 << " ms nps "
+	     << uint64_t(seconds > 0 ? solver._nodes / seconds : 0) << endl;
+
+	if (compare) {  // the same with alpha-beta, to the depth of the mate
+		SearchLimits limits;
+		limits._depth = 2 * (found ? mate_in : max_moves) - 1;
+		start = chrono::steady_clock::now();
+		SearchResult result = chess_board.search(limits, SearchFeatures(), false);
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		cout << "alpha-beta depth " << result._depth << ": " << chess_board.pvToNotation(result._pv)
+		     << " nodes " << result._nodes << " time " << seconds * 1000 << " ms" << endl;
+	}
+	return found ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef MOVE_HPP
+#define MOVE_HPP
+
+#include "bitboard.hpp"
+
+/* A move packed into 16 bits:
+ *  bits  0- 5: origin square
+ *  bits  6-11: target square
+ *  bits 12-13: promotion piece type - KNIGHT (only meaningful for promotions)
+ *  bits 14-15: special move flag
+ * Moves are passed around by value, the long notation (e.g. "Bf1b5") is only
+ * built when a move is shown to, or read from the user.
+ */
+enum MoveFlag : uint16_t {
+	NORMAL = 0,
+	PROMOTION = 1 << 14,
+	EN_PASSANT = 2 << 14,
+	CASTLING = 3 << 14
+};
+
+struct Move {
+	uint16_t _data;
+
+	Move() = default;
+	constexpr explicit Move(uint16_t data) : _data(data) {}
+	constexpr Move(int from, int to, MoveFlag flag = NORMAL, PieceType promotion = KNIGHT)
+		: _data(uint16_t(flag | ((promotion - KNIGHT) << 12) | (to << 6) | from)) {}
+
+	constexpr int from() const { return _data & 0x3F; }
+	constexpr int to() const { return (_data >> 6) & 0x3F; }
+	constexpr MoveFlag flag() const { return MoveFlag(_data & (3 << 14)); }
+	constexpr PieceType promotion() const { return PieceType(((_data >> 12) & 3) + KNIGHT); }
+
+	constexpr bool operator==(Move other) const { return _data == other._data; }
+	constexpr bool operator!=(Move other) const { return _data != other._data; }
+	constexpr explicit operator bool() const { return _data != 0; }
+};
+
+constexpr Move MOVE_NONE {uint16_t(0)};  // a1a1, can never be a real move
+
+const int MAX_MOVES = 256;  // no legal position has more than 218 moves
+
+/* Fixed-capacity list of moves, lives on the stack and never allocates.
+ */
+struct MoveList {
+	Move _moves[MAX_MOVES];
+	int _size = 0;
+
+	void push(Move m) { _moves[_size++] = m; }
+	int size() const { return _size; }
+	bool empty() const { return _size == 0; }
+	void clear() { _size = 0; }
+	Move& operator[](int i) { return _moves[i]; }
+	Move operator[](int i) const { return _moves[i]; }
+	Move* begin() { return _moves; }
+	Move* end() { return _moves + _size; }
+	const Move* begin() const { return _moves; }
+	const Move* end() const { return _moves + _size; }
+
+	bool contains(Move m) const {
+		for (Move move : *this) {
+			if (move == m) return true;
+		}
+		return false;
+	}
+};
+
+#endif
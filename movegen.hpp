@@ -0,0 +1,320 @@
+#ifndef MOVEGEN_HPP
+#define MOVEGEN_HPP
+
+#include "position.hpp"
+#include "attacks.hpp"
+
+/* Move generation on the bitboard Position. The side to move is a template
+ * parameter, so the pawn direction and which pieces are "own" and "enemy" are
+ * compile time constants and no color branch is left inside the loops.
+ */
+
+// which moves to generate: CAPTURES also contains all promotions and en passant,
+// QUIETS all other moves (including castling), ALL is both
+enum GenType { CAPTURES, QUIETS, ALL };
+
+template<Color Us>
+constexpr int pawnPush() { return (Us == WHITE) ? 8 : -8; }
+
+template<Color Us>
+constexpr Bitboard shiftForward(Bitboard b) { return (Us == WHITE) ? b << 8 : b >> 8; }
+
+template<Color Us>
+Bitboard pawnTargets(const Position& pos, int sq) {
+	/* squares a pawn can move to: one step forward onto an empty square (two from
+	 * its initial row), or one step diagonally forward onto an enemy figure or the
+	 * en passant square
+	 */
+	constexpr Color Them = !Us;
+	constexpr Bitboard RANK_3 = (Us == WHITE) ? RANK_3_BB : RANK_6_BB;
+	Bitboard empty = ~pos.occupied();
+	Bitboard enemies = pos.pieces(Them);
+	if (pos._ep != NO_SQUARE && pos.sideToMove() == Us)
+		enemies |= squareBB(pos._ep);
+
+	Bitboard single = shiftForward<Us>(squareBB(sq)) & empty;
+	Bitboard targets = single | (shiftForward<Us>(single & RANK_3) & empty);
+	return targets | (pawnAttacks(Us, sq) & enemies);
+}
+
+template<Color Us>
+Bitboard pieceTargets(const Position& pos, PieceType type, int sq) {
+	/* squares a figure of type >>type<< on >>sq<< can move to (empty or enemy),
+	 * castling is not included
+	 */
+	Bitboard not_own = ~pos.pieces(Us);
+	switch (type) {
+		case PAWN:   return pawnTargets<Us>(pos, sq);
+		case KNIGHT: return knightAttacks(sq) & not_own;
+		case BISHOP: return bishopAttacks(sq, pos.occupied()) & not_own;
+		case ROOK:   return rookAttacks(sq, pos.occupied()) & not_own;
+		case QUEEN:  return queenAttacks(sq, pos.occupied()) & not_own;
+		case KING:   return kingAttacks(sq) & not_own;
+		default:     return 0;
+	}
+}
+
+inline Bitboard attackersTo(const Position& pos, int sq, Bitboard occupied) {
+	/* all figures of both colors attacking >>sq<<, sliders are blocked by >>occupied<<
+	 */
+	Bitboard rooks_queens = pos.pieces(WHITE, ROOK) | pos.pieces(WHITE, QUEEN)
+	                      | pos.pieces(BLACK, ROOK) | pos.pieces(BLACK, QUEEN);
+	Bitboard bishops_queens = pos.pieces(WHITE, BISHOP) | pos.pieces(WHITE, QUEEN)
+	                        | pos.pieces(BLACK, BISHOP) | pos.pieces(BLACK, QUEEN);
+	return (pawnAttacks(BLACK, sq) & pos.pieces(WHITE, PAWN))  // white pawns attack like a black pawn looks
+	     | (pawnAttacks(WHITE, sq) & pos.pieces(BLACK, PAWN))
+	     | (knightAttacks(sq) & (pos.pieces(WHITE, KNIGHT) | pos.pieces(BLACK, KNIGHT)))
+	     | (kingAttacks(sq) & (pos.pieces(WHITE, KING) | pos.pieces(BLACK, KING)))
+	     | (rookAttacks(sq, occupied) & rooks_queens)
+	     | (bishopAttacks(sq, occupied) & bishops_queens);
+}
+
+template<Color Us>
+bool isAttacked(const Position& pos, int sq) {
+	/* true if any figure of the opponent of Us attacks >>sq<<
+	 */
+	return attackersTo(pos, sq, pos.occupied()) & pos.pieces(!Us);
+}
+
+template<Color Us>
+Bitboard checkers(const Position& pos) {
+	/* enemy figures giving check to the king of Us (if Us has no king, none)
+	 */
+	Bitboard king = pos.pieces(Us, KING);
+	return king ? attackersTo(pos, lsb(king), pos.occupied()) & pos.pieces(!Us) : 0;
+}
+
+template<Color Us>
+Bitboard pinnedPieces(const Position& pos, int ksq) {
+	/* own figures that are the only blocker between the king on >>ksq<< and an
+	 * enemy slider. A sniper is a slider that would attack the king on an empty board.
+	 */
+	constexpr Color Them = !Us;
+	Bitboard snipers = (rookAttacks(ksq, 0) & (pos.pieces(Them, ROOK) | pos.pieces(Them, QUEEN)))
+	                 | (bishopAttacks(ksq, 0) & (pos.pieces(Them, BISHOP) | pos.pieces(Them, QUEEN)));
+	Bitboard pinned = 0;
+	while (snipers) {
+		Bitboard blockers = betweenBB(ksq, popLsb(snipers)) & pos.occupied();
+		if (blockers && !moreThanOne(blockers))
+			pinned |= blockers & pos.pieces(Us);
+	}
+	return pinned;
+}
+
+template<Color Us, GenType Type, typename Visitor>
+bool generatePawnMoves(const Position& pos, Bitboard target_mask, Bitboard pinned, int ksq, Visitor& visit) {
+	/* pawn part of generateLegalMoves(). Pushes are generated for all pawns at once.
+	 */
+	constexpr Color Them = !Us;
+	constexpr int UP = pawnPush<Us>();
+	constexpr Bitboard RANK_3 = (Us == WHITE) ? RANK_3_BB : RANK_6_BB;
+	constexpr Bitboard RANK_7 = (Us == WHITE) ? RANK_7_BB : RANK_2_BB;
+	const PieceType promotions[4] {QUEEN, KNIGHT, ROOK, BISHOP};
+
+	Bitboard empty = ~pos.occupied();
+	Bitboard enemies = pos.pieces(Them);
+	Bitboard pawns = pos.pieces(Us, PAWN) & ~RANK_7;
+	Bitboard promoting = pos.pieces(Us, PAWN) & RANK_7;
+
+	// a pinned pawn may only move along the line through its king
+	auto unpinned = [&](int from, int to) { return !(pinned & squareBB(from)) || aligned(ksq, from, to); };
+
+	if (Type != CAPTURES) {
+		Bitboard single = shiftForward<Us>(pawns) & empty;
+		Bitboard twice = shiftForward<Us>(single & RANK_3) & empty & target_mask;
+		single &= target_mask;
+		while (single) {
+			int to = popLsb(single);
+			if (unpinned(to - UP, to) && visit(Move(to - UP, to))) return true;
+		}
+		while (twice) {
+			int to = popLsb(twice);
+			if (unpinned(to - 2 * UP, to) && visit(Move(to - 2 * UP, to))) return true;
+		}
+	}
+
+	if (Type != QUIETS) {
+		while (pawns) {
+			int from = popLsb(pawns);
+			Bitboard captures = pawnAttacks(Us, from) & enemies & target_mask;
+			while (captures) {
+				int to = popLsb(captures);
+				if (unpinned(from, to) && visit(Move(from, to))) return true;
+			}
+		}
+
+		while (promoting) {
+			int from = popLsb(promoting);
+			Bitboard targets = ((pawnAttacks(Us, from) & enemies) | (shiftForward<Us>(squareBB(from)) & empty)) & target_mask;
+			while (targets) {
+				int to = popLsb(targets);
+				if (!unpinned(from, to)) continue;
+				for (PieceType promotion : promotions) {
+					if (visit(Move(from, to, PROMOTION, promotion))) return true;
+				}
+			}
+		}
+
+		// en passant removes two pieces from one row, which can expose the king to a
+		// slider, so it is verified with the resulting occupancy
+		if (pos._ep != NO_SQUARE && pos.sideToMove() == Us) {
+			int ep = pos._ep, captured = ep - UP;
+			Bitboard candidates = pawnAttacks(Them, ep) & pos.pieces(Us, PAWN);
+			while (candidates) {
+				int from = popLsb(candidates);
+				Bitboard occupied = (pos.occupied() ^ squareBB(from) ^ squareBB(captured)) | squareBB(ep);
+				if (ksq != NO_SQUARE && (attackersTo(pos, ksq, occupied) & pos.pieces(Them) & ~squareBB(captured)))
+					continue;
+				if (visit(Move(from, ep, EN_PASSANT))) return true;
+			}
+		}
+	}
+	return false;
+}
+
+template<Color Us, GenType Type = ALL, typename Visitor>
+bool generateLegalMoves(const Position& pos, Visitor&& visit) {
+	/* calls visit(move) for every legal move of the side Us. The visitor returns
+	 * true to stop the generation early, in which case true is returned as well.
+	 * Nothing is stored, so counting or filtering moves is free of copies.
+	 *
+	 * Checkers and pinned pieces are computed once, after that every generated
+	 * move is legal without trying it:
+	 *  - the king may only go to squares that are not attacked (with the king itself
+	 *    removed from the board, so it cannot hide behind itself from a slider)
+	 *  - in double check only the king can move
+	 *  - in single check the other figures must capture the checker or block it
+	 *  - pinned figures may only move along the line through king and pinner
+	 * Hand-built boards without a king are allowed, then every move is legal.
+	 */
+	PROFILE_SCOPE("generateLegalMoves");
+	constexpr Color Them = !Us;
+	Bitboard occupied = pos.occupied();
+	Bitboard king = pos.pieces(Us, KING);
+	Bitboard type_mask = (Type == CAPTURES) ? pos.pieces(Them)
+	                   : (Type == QUIETS) ? ~occupied : ~pos.pieces(Us);
+
+	int ksq = king ? lsb(king) : NO_SQUARE;
+	Bitboard check = king ? attackersTo(pos, ksq, occupied) & pos.pieces(Them) : 0;
+
+	if (king) {
+		Bitboard king_targets = kingAttacks(ksq) & type_mask;
+		while (king_targets) {
+			int to = popLsb(king_targets);
+			if (!(attackersTo(pos, to, occupied ^ king) & pos.pieces(Them)))
+				if (visit(Move(ksq, to))) return true;
+		}
+		if (moreThanOne(check))
+			return false;
+	}
+
+	Bitboard target_mask = check ? (betweenBB(ksq, lsb(check)) | check) : ~pos.pieces(Us);
+	Bitboard pinned = king ? pinnedPieces<Us>(pos, ksq) : 0;
+
+	if (generatePawnMoves<Us, Type>(pos, target_mask, pinned, ksq, visit))
+		return true;
+
+	for (int type = KNIGHT; type <= QUEEN; type++) {
+		Bitboard figures = pos.pieces(Us, PieceType(type));
+		while (figures) {
+			int from = popLsb(figures);
+			Bitboard targets = pieceTargets<Us>(pos, PieceType(type), from) & target_mask & type_mask;
+			if (pinned & squareBB(from))
+				targets &= lineBB(ksq, from);
+			while (targets) {
+				if (visit(Move(from, popLsb(targets)))) return true;
+			}
+		}
+	}
+
+	// castling: king and rook on their squares (guaranteed by the rights), the squares
+	// between them empty, and the king neither in check nor passing an attacked square
+	if (Type != CAPTURES && king && !check) {
+		constexpr uint8_t OO = (Us == WHITE) ? WHITE_OO : BLACK_OO;
+		constexpr uint8_t OOO = (Us == WHITE) ? WHITE_OOO : BLACK_OOO;
+		if ((pos._castling & OO) && !(occupied & (squareBB(ksq + 1) | squareBB(ksq + 2)))
+		    && !isAttacked<Us>(pos, ksq + 1) && !isAttacked<Us>(pos, ksq + 2))
+			if (visit(Move(ksq, ksq + 2, CASTLING))) return true;
+		if ((pos._castling & OOO) && !(occupied & (squareBB(ksq - 1) | squareBB(ksq - 2) | squareBB(ksq - 3)))
+		    && !isAttacked<Us>(pos, ksq - 1) && !isAttacked<Us>(pos, ksq - 2))
+			if (visit(Move(ksq, ksq - 2, CASTLING))) return true;
+	}
+	return false;
+}
+
+template<Color Us, GenType Type = ALL>
+void generateLegalMoves(const Position& pos, MoveList& moves) {
+	/* appends all legal moves of the side Us to >>moves<<
+	 */
+	generateLegalMoves<Us, Type>(pos, [&](Move m) { moves.push(m); return false; });
+}
+
+template<Color Us>
+bool hasLegalMove(const Position& pos) {
+	return generateLegalMoves<Us>(pos, [](Move) { return true; });  // stop at the first move
+}
+
+template<Color Us>
+bool isLegalMove(const Position& pos, Move m) {
+	/* checks a single move from an untrusted source (user input, a hash table)
+	 * without generating all moves
+	 */
+	constexpr Color Them = !Us;
+	int from = m.from(), to = m.to();
+	Piece piece = pos.pieceOn(from);
+	if (piece == NO_PIECE || colorOf(piece) != Us || !m)
+		return false;
+
+	// the special moves are rare, they are looked up among the generated moves
+	if (m.flag() == CASTLING || m.flag() == EN_PASSANT)
+		return generateLegalMoves<Us>(pos, [m](Move move) { return move == m; });
+
+	PieceType type = typeOf(piece);
+	bool promotes = (type == PAWN) && (squareBB(to) & (RANK_1_BB | RANK_8_BB));
+	if ((m.flag() == PROMOTION) != promotes || (!promotes && m.promotion() != KNIGHT))
+		return false;  // the promotion bits of other moves are always 0
+	if (type == PAWN && to == pos._ep && colOf(from) != colOf(to))
+		return false;  // would be en passant without the flag
+	if (!(pieceTargets<Us>(pos, type, from) & squareBB(to)))
+		return false;
+
+	Bitboard king = pos.pieces(Us, KING);
+	if (!king)
+		return true;
+	if (type == KING)
+		return !(attackersTo(pos, to, pos.occupied() ^ king) & pos.pieces(Them));
+
+	int ksq = lsb(king);
+	Bitboard check = attackersTo(pos, ksq, pos.occupied()) & pos.pieces(Them);
+	if (moreThanOne(check) || (check && !((betweenBB(ksq, lsb(check)) | check) & squareBB(to))))
+		return false;
+	return !(pinnedPieces<Us>(pos, ksq) & squareBB(from)) || aligned(ksq, from, to);
+}
+
+/* The same functions for the side to move of the position, the color is
+ * dispatched once and then the specialized code runs.
+ */
+template<GenType Type = ALL, typename Visitor>
+bool forEachLegalMove(const Position& pos, Visitor&& visit) {
+	if (pos.sideToMove() == WHITE)
+		return generateLegalMoves<WHITE, Type>(pos, visit);
+	return generateLegalMoves<BLACK, Type>(pos, visit);
+}
+
+template<GenType Type = ALL>
+void generateMoves(const Position& pos, MoveList& moves) {
+	if (pos.sideToMove() == WHITE)
+		generateLegalMoves<WHITE, Type>(pos, moves);
+	else
+		generateLegalMoves<BLACK, Type>(pos, moves);
+}
+
+inline bool isLegal(const Position& pos, Move m) {
+	return (pos.sideToMove() == WHITE) ? isLegalMove<WHITE>(pos, m) : isLegalMove<BLACK>(pos, m);
+}
+
+inline bool inCheck(const Position& pos) {
+	return (pos.sideToMove() == WHITE) ? checkers<WHITE>(pos) : checkers<BLACK>(pos);
+}
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef MOVEPICKER_HPP
+#define MOVEPICKER_HPP
+
+#include "movegen.hpp"
+#include "see.hpp"
+
+/* Staged move generation: the moves of a position are handed out one by one,
+ * first the hash move (if legal), then the captures and promotions that do not
+ * lose material, then the killer moves, the other quiet moves and at last the
+ * losing captures. Every stage is only generated when the consumer asks for its
+ * first move, so a search that cuts off after the hash move or a capture never
+ * pays for the quiet moves.
+ *
+ * Inside a stage the best scored move comes first (selection sort, a cutoff
+ * usually comes early, so most of the list is never sorted):
+ *  - captures by MVV-LVA, most valuable victim first, of equal victims the one
+ *    taken by the least valuable attacker. A capture that loses material by
+ *    static exchange evaluation is moved to the end.
+ *  - quiet moves by their history score, how often they caused a cutoff so far
+ * Killer moves are quiet moves that caused a cutoff at the same ply in another
+ * branch, they are tried before all other quiet moves.
+ *
+ * For the quiescence search the picker hands out only the captures that do not
+ * lose material.
+ */
+enum PickerStage {
+	STAGE_HASH_MOVE,
+	STAGE_GEN_CAPTURES,
+	STAGE_GOOD_CAPTURES,
+	STAGE_KILLERS,
+	STAGE_GEN_QUIETS,
+	STAGE_QUIETS,
+	STAGE_BAD_CAPTURES,
+	STAGE_DONE
+};
+
+/* history heuristic: a score per side, origin and target square of quiet moves.
+ * Moves causing a cutoff gain, the quiet moves tried before them lose. The update
+ * shrinks with the size of the score, so scores stay within +-HISTORY_MAX and
+ * newer results count more than old ones.
+ */
+const int HISTORY_MAX = 16384;
+
+struct HistoryTable {
+	int _scores[2][64][64];  // [color][from][to]
+
+	HistoryTable() { clear(); }
+	void clear() { memset(_scores, 0, sizeof(_scores)); }
+	int get(Color c, Move m) const { return _scores[c][m.from()][m.to()]; }
+	void update(Color c, Move m, int bonus) {
+		int& score = _scores[c][m.from()][m.to()];
+		score += bonus - score * std::abs(bonus) / HISTORY_MAX;
+	}
+};
+
+// MVV-LVA order of a capture or promotion, higher is tried first
+inline int mvvLva(const Position& pos, Move m) {
+	return 8 * captureValue(pos, m) - typeOf(pos.pieceOn(m.from()));
+}
+
+struct MovePicker {
+	const Position& _pos;
+	Move _hash_move;
+	Move _killers[2];
+	const HistoryTable* _history;  // nullptr: quiet moves in generation order
+	bool _quiescence;
+	int _stage;
+	MoveList _moves;
+	int _scores[MAX_MOVES];
+	int _index;
+	int _killer_index = 0;
+	MoveList _bad_captures;
+
+	MovePicker(const Position& pos, Move hash_move = MOVE_NONE, const Move* killers = nullptr,
+	           const HistoryTable* history = nullptr);
+	explicit MovePicker(const Position& pos, bool quiescence);
+	Move next();
+	Move pickBest();
+	void sortMoves();
+	bool isKiller(Move m) const { return m == _killers[0] || m == _killers[1]; }
+};
+
+MovePicker::MovePicker(const Position& pos, Move hash_move, const Move* killers, const HistoryTable* history)
+	: _pos(pos), _hash_move(hash_move), _history(history), _quiescence(false) {
+	_stage = STAGE_HASH_MOVE;
+	_index = 0;
+	if (_hash_move && !isLegal(_pos, _hash_move))  // e.g. a hash collision
+		_hash_move = MOVE_NONE;
+	_killers[0] = killers ? killers[0] : MOVE_NONE;
+	_killers[1] = killers ? killers[1] : MOVE_NONE;
+}
+
+MovePicker::MovePicker(const Position& pos, bool quiescence)
+	: _pos(pos), _hash_move(MOVE_NONE), _killers {MOVE_NONE, MOVE_NONE}, _history(nullptr), _quiescence(quiescence) {
+	_stage = STAGE_GEN_CAPTURES;
+	_index = 0;
+}
+
+Move MovePicker::pickBest() {
+	/* swaps the best scored of the remaining moves to the front and returns it
+	 */
+	int best = _index;
+	for (int i = _index + 1; i < _moves.size(); i++) {
+		if (_scores[i] > _scores[best]) best = i;
+	}
+	std::swap(_moves[best], _moves[_index]);
+	std::swap(_scores[best], _scores[_index]);
+	return _moves[_index++];
+}
+
+void MovePicker::sortMoves() {
+	/* insertion sort of all moves by score, stable, for lists that are mostly
+	 * searched to the end
+	 */
+	for (int i = 1; i < _moves.size(); i++) {
+		Move m = _moves[i];
+		int score = _scores[i], j = i;
+		for (; j > 0 && _scores[j - 1] < score; j--) {
+			_moves[j] = _moves[j - 1];
+			_scores[j] = _scores[j - 1];
+		}
+		_moves[j] = m;
+		_scores[j] = score;
+	}
+}
+
+Move MovePicker::next() {
+	/* returns the next legal move, MOVE_NONE if there are no more moves
+	 */
+	switch (_stage) {
+		case STAGE_HASH_MOVE:
+			_stage++;
+			if (_hash_move)
+				return _hash_move;
+			[[fallthrough]];
+
+		case STAGE_GEN_CAPTURES:
+			_moves.clear();
+			_index = 0;
+			generateMoves<CAPTURES>(_pos, _moves);
+			for (int i = 0; i < _moves.size(); i++)
+				_scores[i] = mvvLva(_pos, _moves[i]);
+			_stage++;
+			[[fallthrough]];
+
+		case STAGE_GOOD_CAPTURES:
+			while (_index < _moves.size()) {
+				Move m = pickBest();
+				if (m == _hash_move) continue;  // the hash move was already handed out
+				if (see(_pos, m) < 0) {
+					_bad_captures.push(m);
+					continue;
+				}
+				return m;
+			}
+			if (_quiescence) {
+				_stage = STAGE_DONE;
+				return MOVE_NONE;
+			}
+			_stage++;
+			[[fallthrough]];
+
+		case STAGE_KILLERS:
+			// a killer is a quiet move from another position, it must be legal here
+			while (_killer_index < 2) {
+				Move m = _killers[_killer_index++];
+				if (m && m != _hash_move && !_pos.isCapture(m) && m.flag() != PROMOTION && isLegal(_pos, m))
+					return m;
+			}
+			_stage++;
+			[[fallthrough]];
+
+		case STAGE_GEN_QUIETS:
+			_moves.clear();
+			_index = 0;
+			generateMoves<QUIETS>(_pos, _moves);
+			if (_history) {
+				for (int i = 0; i < _moves.size(); i++)
+					_scores[i] = _history->get(_pos.sideToMove(), _moves[i]);
+				sortMoves();
+			}
+			_stage++;
+			[[fallthrough]];
+
+		case STAGE_QUIETS:
+			while (_index < _moves.size()) {
+				Move m = _moves[_index++];
+				if (m != _hash_move && !isKiller(m)) return m;
+			}
+			_index = 0;
+			_stage++;
+			[[fallthrough]];
+
+		case STAGE_BAD_CAPTURES:
+			if (_index < _bad_captures.size())
+				return _bad_captures[_index++];
+			_stage++;
+			[[fallthrough]];
+
+		default:
+			return MOVE_NONE;
+	}
+}
+
+#endif
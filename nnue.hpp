@@ -0,0 +1,430 @@
+#ifndef NNUE_HPP
+#define NNUE_HPP
+
+#include "bitboard.hpp"
+#include "zobrist.hpp"  // splitMix64
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NNUE_X86
+#endif
+
+/* Efficiently updatable neural network (NNUE) evaluation.
+ *
+ * Network: 40960 -> 2x128 -> 32 -> 32 -> 1
+ *  - the input features are HalfKP: for each side ("perspective") one feature per
+ *    (own king square, non-king piece, square) that is present. The first layer is
+ *    the sum of the weight rows of the present features, kept per perspective in an
+ *    accumulator of 128 int16. A move changes only a few features, so the
+ *    accumulator is updated by adding and subtracting a few rows instead of being
+ *    recomputed. A move of the own king changes all features of its perspective,
+ *    that perspective is recomputed at the next evaluation.
+ *  - the two accumulators, side to move first, are clipped to [0, 127] (clipped
+ *    ReLU) into 256 uint8 and go through two int8 affine layers with clipped ReLU
+ *    and an int8 output layer, all in integers.
+ *
+ * Kernels: every vector operation exists as AVX2, SSE (SSSE3) and scalar code, all
+ * compiled into the same binary with target attributes. The fastest kernel the CPU
+ * supports is chosen at start, nnue_kernel can be changed to compare them; all
+ * kernels compute exactly the same result.
+ *
+ * The weights are loaded with mmap from a binary file (little endian):
+ *   64 byte header: "C73NNUE1", then the dimensions as 4 uint32
+ *   feature transformer bias int16[128], weights int16[40960][128]
+ *   hidden layer 1 bias int32[32], weights int8[32][256]
+ *   hidden layer 2 bias int32[32], weights int8[32][32]
+ *   output bias int32[1], weights int8[32]
+ * every section starts at a multiple of 64 bytes. The int8 weights must be in
+ * [-127, 127], otherwise the pairwise multiply-add of the SIMD kernels saturates.
+ * No trained network is shipped, writeRandomNetwork() creates one with random
+ * weights, e.g. to measure the speed or as the starting point for a trainer.
+ *
+ * Compiled with -DUSE_NNUE, Position carries an accumulator that putPiece(),
+ * removePiece() and movePiece() keep up to date, and evaluate() uses the network
+ * once one is loaded.
+ */
+
+const int NNUE_PIECE_SQUARES = 10 * 64;  // piece kinds without the kings * squares
+const int NNUE_FEATURES = 64 * NNUE_PIECE_SQUARES;
+const int NNUE_HALF = 128;               // accumulator size of one perspective
+const int NNUE_INPUT = 2 * NNUE_HALF;
+const int NNUE_L1 = 32;
+const int NNUE_L2 = 32;
+const int NNUE_WEIGHT_SHIFT = 6;         // hidden layer weights are scaled by 64
+const int NNUE_OUTPUT_DIVISOR = 16;      // network output per centipawn
+const char NNUE_MAGIC[9] = "C73NNUE1";
+
+struct NnueLayout {
+	size_t _ft_bias, _ft_weights, _l1_bias, _l1_weights, _l2_bias, _l2_weights, _out_bias, _out_weights, _size;
+};
+
+constexpr NnueLayout makeNnueLayout() {
+	NnueLayout layout {};
+	size_t offset = 64;  // header
+	auto section = [&offset](size_t bytes) {
+		size_t start = offset;
+		offset = (offset + bytes + 63) & ~size_t(63);
+		return start;
+	};
+	layout._ft_bias = section(NNUE_HALF * sizeof(int16_t));
+	layout._ft_weights = section(size_t(NNUE_FEATURES) * NNUE_HALF * sizeof(int16_t));
+	layout._l1_bias = section(NNUE_L1 * sizeof(int32_t));
+	layout._l1_weights = section(NNUE_L1 * NNUE_INPUT);
+	layout._l2_bias = section(NNUE_L2 * sizeof(int32_t));
+	layout._l2_weights = section(NNUE_L2 * NNUE_L1);
+	layout._out_bias = section(sizeof(int32_t));
+	layout._out_weights = section(NNUE_L2);
+	layout._size = offset;
+	return layout;
+}
+
+constexpr NnueLayout NNUE_LAYOUT = makeNnueLayout();
+
+struct NnueNetwork {
+	void* _mapping = nullptr;
+	size_t _size = 0;
+	const int16_t* _ft_bias;
+	const int16_t* _ft_weights;  // [feature][NNUE_HALF]
+	const int32_t* _l1_bias;
+	const int8_t* _l1_weights;   // [NNUE_L1][NNUE_INPUT]
+	const int32_t* _l2_bias;
+	const int8_t* _l2_weights;   // [NNUE_L2][NNUE_L1]
+	const int32_t* _out_bias;
+	const int8_t* _out_weights;  // [NNUE_L2]
+
+	~NnueNetwork() { unload(); }
+	bool loaded() const { return _mapping != nullptr; }
+	void load(const std::string& filename);
+	void unload();
+};
+
+NnueNetwork NNUE;
+
+void NnueNetwork::load(const std::string& filename) {
+	/* maps the network file into memory, throws std::runtime_error if it cannot be
+	 * read or does not match the architecture
+	 */
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open network " + filename);
+	struct stat info;
+	if (fstat(fd, &info) != 0 || size_t(info.st_size) != NNUE_LAYOUT._size) {
+		close(fd);
+		throw std::runtime_error("Network " + filename + " has not the size of this architecture");
+	}
+	void* mapping = mmap(nullptr, NNUE_LAYOUT._size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);  // the mapping stays valid
+	if (mapping == MAP_FAILED)
+		throw std::runtime_error("Cannot map network " + filename);
+
+	const char* base = static_cast<const char*>(mapping);
+	uint32_t dims[4];
+	memcpy(dims, base + 8, sizeof(dims));
+	if (memcmp(base, NNUE_MAGIC, 8) != 0 || dims[0] != NNUE_FEATURES || dims[1] != NNUE_HALF
+	    || dims[2] != NNUE_L1 || dims[3] != NNUE_L2) {
+		munmap(mapping, NNUE_LAYOUT._size);
+		throw std::runtime_error("Network " + filename + " has a different format or architecture");
+	}
+
+	unload();
+	_mapping = mapping;
+	_size = NNUE_LAYOUT._size;
+	_ft_bias = reinterpret_cast<const int16_t*>(base + NNUE_LAYOUT._ft_bias);
+	_ft_weights = reinterpret_cast<const int16_t*>(base + NNUE_LAYOUT._ft_weights);
+	_l1_bias = reinterpret_cast<const int32_t*>(base + NNUE_LAYOUT._l1_bias);
+	_l1_weights = reinterpret_cast<const int8_t*>(base + NNUE_LAYOUT._l1_weights);
+	_l2_bias = reinterpret_cast<const int32_t*>(base + NNUE_LAYOUT._l2_bias);
+	_l2_weights = reinterpret_cast<const int8_t*>(base + NNUE_LAYOUT._l2_weights);
+	_out_bias = reinterpret_cast<const int32_t*>(base + NNUE_LAYOUT._out_bias);
+	_out_weights = reinterpret_cast<const int8_t*>(base + NNUE_LAYOUT._out_weights);
+}
+
+void NnueNetwork::unload() {
+	if (_mapping)
+		munmap(_mapping, _size);
+	_mapping = nullptr;
+	_size = 0;
+}
+
+void writeRandomNetwork(const std::string& filename, uint64_t seed = 73) {
+	/* writes a network with small random weights, it plays badly but costs exactly
+	 * as much to evaluate as a trained one
+	 */
+	std::string data(NNUE_LAYOUT._size, '\0');
+	char* base = &data[0];
+	uint32_t dims[4] = {NNUE_FEATURES, NNUE_HALF, NNUE_L1, NNUE_L2};
+	memcpy(base, NNUE_MAGIC, 8);
+	memcpy(base + 8, dims, sizeof(dims));
+
+	uint64_t state = seed;
+	auto random = [&state](int range) { return int(splitMix64(state) % (2 * range + 1)) - range; };  // [-range, range]
+	auto fill16 = [&](size_t offset, size_t count, int range) {
+		for (size_t i = 0; i < count; i++) {
+			int16_t v = int16_t(random(range));
+			memcpy(base + offset + i * sizeof(v), &v, sizeof(v));
+		}
+	};
+	auto fill32 = [&](size_t offset, size_t count, int range) {
+		for (size_t i = 0; i < count; i++) {
+			int32_t v = random(range);
+			memcpy(base + offset + i * sizeof(v), &v, sizeof(v));
+		}
+	};
+	auto fill8 = [&](size_t offset, size_t count, int range) {
+		for (size_t i = 0; i < count; i++)
+			base[offset + i] = char(random(range));
+	};
+	fill16(NNUE_LAYOUT._ft_bias, NNUE_HALF, 32);
+	fill16(NNUE_LAYOUT._ft_weights, size_t(NNUE_FEATURES) * NNUE_HALF, 16);
+	fill32(NNUE_LAYOUT._l1_bias, NNUE_L1, 256);
+	fill8(NNUE_LAYOUT._l1_weights, NNUE_L1 * NNUE_INPUT, 24);
+	fill32(NNUE_LAYOUT._l2_bias, NNUE_L2, 256);
+	fill8(NNUE_LAYOUT._l2_weights, NNUE_L2 * NNUE_L1, 24);
+	fill32(NNUE_LAYOUT._out_bias, 1, 64);
+	fill8(NNUE_LAYOUT._out_weights, NNUE_L2, 64);
+
+	std::ofstream file(filename, std::ios::binary);
+	file.write(base, data.size());
+	if (!file)
+		throw std::runtime_error("Cannot write network " + filename);
+}
+
+/* Kernels */
+
+enum NnueKernel { NNUE_SCALAR, NNUE_SSE, NNUE_AVX2 };
+const char* const NNUE_KERNEL_NAMES[] = {"scalar", "sse", "avx2"};
+
+inline bool nnueKernelSupported(NnueKernel kernel) {
+#ifdef NNUE_X86
+	if (kernel == NNUE_AVX2) return __builtin_cpu_supports("avx2");
+	if (kernel == NNUE_SSE) return __builtin_cpu_supports("ssse3");
+#endif
+	return kernel == NNUE_SCALAR;
+}
+
+inline NnueKernel bestNnueKernel() {
+	return nnueKernelSupported(NNUE_AVX2) ? NNUE_AVX2 : nnueKernelSupported(NNUE_SSE) ? NNUE_SSE : NNUE_SCALAR;
+}
+
+NnueKernel nnue_kernel = bestNnueKernel();
+
+// accumulator += Sign * row, NNUE_HALF values
+template<int Sign>
+void nnueRowScalar(int16_t* acc, const int16_t* row) {
+	for (int i = 0; i < NNUE_HALF; i++)
+		acc[i] += Sign * row[i];
+}
+
+// input = clamp(accumulator, 0, 127), NNUE_HALF values
+void nnueClipScalar(const int16_t* acc, uint8_t* input) {
+	for (int i = 0; i < NNUE_HALF; i++)
+		input[i] = uint8_t(std::min(std::max(int(acc[i]), 0), 127));
+}
+
+// output[o] = bias[o] + sum(input[i] * weights[o][i])
+void nnueAffineScalar(const uint8_t* input, int inputs, const int8_t* weights, const int32_t* bias, int outputs, int32_t* output) {
+	for (int o = 0; o < outputs; o++) {
+		int32_t sum = bias[o];
+		for (int i = 0; i < inputs; i++)
+			sum += input[i] * weights[o * inputs + i];
+		output[o] = sum;
+	}
+}
+
+#ifdef NNUE_X86
+template<int Sign>
+__attribute__((target("avx2"))) void nnueRowAvx2(int16_t* acc, const int16_t* row) {
+	for (int i = 0; i < NNUE_HALF; i += 16) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i*>(acc + i));
+		__m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+		a = Sign > 0 ? _mm256_add_epi16(a, r) : _mm256_sub_epi16(a, r);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), a);
+	}
+}
+
+__attribute__((target("avx2"))) void nnueClipAvx2(const int16_t* acc, uint8_t* input) {
+	const __m256i zero = _mm256_setzero_si256();
+	for (int i = 0; i < NNUE_HALF; i += 32) {
+		__m256i a = _mm256_max_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i)), zero);
+		__m256i b = _mm256_max_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i + 16)), zero);
+		// packs saturates to 127 but works per 128 bit lane, the permute restores the order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(input + i), packed);
+	}
+}
+
+__attribute__((target("avx2"))) void nnueAffineAvx2(const uint8_t* input, int inputs, const int8_t* weights,
+                                                    const int32_t* bias, int outputs, int32_t* output) {
+	const __m256i ones = _mm256_set1_epi16(1);
+	for (int o = 0; o < outputs; o++) {
+		__m256i sum = _mm256_setzero_si256();
+		for (int i = 0; i < inputs; i += 32) {
+			__m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+			__m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + o * inputs + i));
+			// uint8 * int8 pairwise to int16, then pairwise to int32
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones));
+		}
+		__m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+		output[o] = bias[o] + _mm_cvtsi128_si32(s);
+	}
+}
+
+template<int Sign>
+__attribute__((target("ssse3"))) void nnueRowSse(int16_t* acc, const int16_t* row) {
+	for (int i = 0; i < NNUE_HALF; i += 8) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<__m128i*>(acc + i));
+		__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+		a = Sign > 0 ? _mm_add_epi16(a, r) : _mm_sub_epi16(a, r);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), a);
+	}
+}
+
+__attribute__((target("ssse3"))) void nnueClipSse(const int16_t* acc, uint8_t* input) {
+	const __m128i zero = _mm_setzero_si128();
+	for (int i = 0; i < NNUE_HALF; i += 16) {
+		__m128i a = _mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i)), zero);
+		__m128i b = _mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i + 8)), zero);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(input + i), _mm_packs_epi16(a, b));
+	}
+}
+
+__attribute__((target("ssse3"))) void nnueAffineSse(const uint8_t* input, int inputs, const int8_t* weights,
+                                                    const int32_t* bias, int outputs, int32_t* output) {
+	const __m128i ones = _mm_set1_epi16(1);
+	for (int o = 0; o < outputs; o++) {
+		__m128i sum = _mm_setzero_si128();
+		for (int i = 0; i < inputs; i += 16) {
+			__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+			__m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + o * inputs + i));
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(in, w), ones));
+		}
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+		output[o] = bias[o] + _mm_cvtsi128_si32(sum);
+	}
+}
+#endif
+
+template<int Sign>
+inline void nnueRow(int16_t* acc, const int16_t* row) {
+#ifdef NNUE_X86
+	if (nnue_kernel == NNUE_AVX2) return nnueRowAvx2<Sign>(acc, row);
+	if (nnue_kernel == NNUE_SSE) return nnueRowSse<Sign>(acc, row);
+#endif
+	nnueRowScalar<Sign>(acc, row);
+}
+
+inline void nnueClip(const int16_t* acc, uint8_t* input) {
+#ifdef NNUE_X86
+	if (nnue_kernel == NNUE_AVX2) return nnueClipAvx2(acc, input);
+	if (nnue_kernel == NNUE_SSE) return nnueClipSse(acc, input);
+#endif
+	nnueClipScalar(acc, input);
+}
+
+inline void nnueAffine(const uint8_t* input, int inputs, const int8_t* weights, const int32_t* bias, int outputs, int32_t* output) {
+#ifdef NNUE_X86
+	if (nnue_kernel == NNUE_AVX2) return nnueAffineAvx2(input, inputs, weights, bias, outputs, output);
+	if (nnue_kernel == NNUE_SSE) return nnueAffineSse(input, inputs, weights, bias, outputs, output);
+#endif
+	nnueAffineScalar(input, inputs, weights, bias, outputs, output);
+}
+
+/* Accumulator */
+
+struct alignas(64) NnueAccumulator {
+	int16_t _values[2][NNUE_HALF];  // [perspective]
+	uint8_t _king[2];               // [perspective] king square the values belong to
+	bool _valid[2];                 // [perspective] false: has to be refreshed before use
+};
+
+inline int nnueFeature(Color perspective, int ksq, Piece piece, int sq) {
+	/* index of the feature "piece on sq" seen from the king of >>perspective<<. Black
+	 * sees the board mirrored, so both perspectives share the weights.
+	 */
+	if (perspective == BLACK) {
+		ksq ^= 56;
+		sq ^= 56;
+	}
+	int kind = (colorOf(piece) != perspective) * 5 + typeOf(piece);  // own pawn ... queen, then the enemy's
+	return ksq * NNUE_PIECE_SQUARES + kind * 64 + sq;
+}
+
+inline void nnueAddPiece(NnueAccumulator& acc, Piece piece, int sq) {
+	if (typeOf(piece) == KING) {
+		acc._valid[colorOf(piece)] = false;
+		return;
+	}
+	for (Color p : {WHITE, BLACK}) {
+		if (acc._valid[p])
+			nnueRow<1>(acc._values[p], NNUE._ft_weights + size_t(nnueFeature(p, acc._king[p], piece, sq)) * NNUE_HALF);
+	}
+}
+
+inline void nnueRemovePiece(NnueAccumulator& acc, Piece piece, int sq) {
+	if (typeOf(piece) == KING) {
+		acc._valid[colorOf(piece)] = false;
+		return;
+	}
+	for (Color p : {WHITE, BLACK}) {
+		if (acc._valid[p])
+			nnueRow<-1>(acc._values[p], NNUE._ft_weights + size_t(nnueFeature(p, acc._king[p], piece, sq)) * NNUE_HALF);
+	}
+}
+
+inline void nnueMovePiece(NnueAccumulator& acc, Piece piece, int from, int to) {
+	nnueRemovePiece(acc, piece, from);
+	nnueAddPiece(acc, piece, to);
+}
+
+void nnueRefresh(NnueAccumulator& acc, Color perspective, const Piece board[64]) {
+	/* recomputes the accumulator of one perspective from the board. Boards without
+	 * a king of that color use the king square a1.
+	 */
+	int ksq = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		if (board[sq] == makePiece(perspective, KING))
+			ksq = sq;
+	}
+	int16_t* values = acc._values[perspective];
+	memcpy(values, NNUE._ft_bias, sizeof(acc._values[perspective]));
+	for (int sq = 0; sq < 64; sq++) {
+		if (board[sq] != NO_PIECE && typeOf(board[sq]) != KING)
+			nnueRow<1>(values, NNUE._ft_weights + size_t(nnueFeature(perspective, ksq, board[sq], sq)) * NNUE_HALF);
+	}
+	acc._king[perspective] = uint8_t(ksq);
+	acc._valid[perspective] = true;
+}
+
+int nnueForward(const NnueAccumulator& acc, Color side) {
+	/* runs the layers after the accumulator, returns centipawns for >>side<<
+	 */
+	alignas(64) uint8_t input[NNUE_INPUT];
+	alignas(64) int32_t l1_out[NNUE_L1];
+	alignas(64) uint8_t l1_act[NNUE_L1];
+	alignas(64) int32_t l2_out[NNUE_L2];
+	alignas(64) uint8_t l2_act[NNUE_L2];
+	int32_t output;
+
+	nnueClip(acc._values[side], input);
+	nnueClip(acc._values[!side], input + NNUE_HALF);
+	nnueAffine(input, NNUE_INPUT, NNUE._l1_weights, NNUE._l1_bias, NNUE_L1, l1_out);
+	for (int i = 0; i < NNUE_L1; i++)
+		l1_act[i] = uint8_t(std::min(std::max(l1_out[i] >> NNUE_WEIGHT_SHIFT, 0), 127));
+	nnueAffine(l1_act, NNUE_L1, NNUE._l2_weights, NNUE._l2_bias, NNUE_L2, l2_out);
+	for (int i = 0; i < NNUE_L2; i++)
+		l2_act[i] = uint8_t(std::min(std::max(l2_out[i] >> NNUE_WEIGHT_SHIFT, 0), 127));
+	nnueAffine(l2_act, NNUE_L2, NNUE._out_weights, NNUE._out_bias, 1, &output);
+	return output / NNUE_OUTPUT_DIVISOR;
+}
+
+#endif
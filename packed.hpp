@@ -0,0 +1,404 @@
+#ifndef PACKED_HPP
+#define PACKED_HPP
+
+#include "position.hpp"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/* Packed positions, for datasets of millions of positions (analysis, training):
+ * a fixed size record of 32 bytes holding everything of a FEN, plus a score and
+ * the result of the game the position is from. A file of packed positions is
+ * nothing but the records one after the other, in the byte order of the machine
+ * (little endian on everything this runs on), without any header, so files can
+ * simply be concatenated or split, and record i is at byte 32 * i.
+ *
+ * The pieces are stored like in a FEN, only denser: the occupied squares as one
+ * bitboard, then the Piece of every occupied square, from a1 to h8, in 4 bits
+ * each (the Piece values fit, white pieces are 0-5, black ones 8-13). At most 32
+ * pieces fit, which is every position of a game of chess.
+ *
+ * Files are read either by mapping them into memory (PackedPositionFile, random
+ * access and the fastest) or in large chunks (PackedPositionReader, for files
+ * larger than the address space or on pipes). Either way nothing is parsed, the
+ * records are used in place, and unpackPosition() sets up a complete Position
+ * (keys and scores included) from one.
+ *
+ * Command line tools, see packedMain():
+ *   main packed pack <FEN file> <packed file>    converts a file of FENs
+ *   main packed fen <packed file>                prints the positions as FENs
+ *   main packed bench <packed file> [--stream]   unpacks all positions, timed
+ *   main packed check                            checks packing and unpacking
+ */
+
+const int16_t PACKED_SCORE_NONE = INT16_MIN;
+
+enum PackedResult : uint8_t { PACKED_BLACK_WINS, PACKED_DRAW, PACKED_WHITE_WINS, PACKED_RESULT_UNKNOWN };
+const char* const PACKED_RESULT_NAMES[] = {"0-1", "1/2-1/2", "1-0"};
+
+struct PackedPosition {
+	uint64_t _occupied;   // squares with a piece
+	uint8_t _pieces[16];  // Piece of each occupied square in square order, 4 bits each, low nibble first
+	uint8_t _flags;       // bit 0 side to move, bits 1-4 castling rights
+	uint8_t _ep;          // en passant square, NO_SQUARE if none
+	uint8_t _rule50;
+	uint8_t _result;      // PackedResult
+	uint16_t _game_ply;
+	int16_t _score;       // centipawns from the side to move, PACKED_SCORE_NONE if there is none
+};
+
+static_assert(sizeof(PackedPosition) == 32, "a packed position has 32 bytes");
+
+PackedPosition packPosition(const Position& pos, int16_t score = PACKED_SCORE_NONE,
+                            PackedResult result = PACKED_RESULT_UNKNOWN) {
+	/* the record of >>pos<<, throws std::invalid_argument if it has more than the
+	 * 32 pieces a record holds (setFen() takes any number of pieces)
+	 */
+	if (popCount(pos.occupied()) > 32)
+		throw std::invalid_argument("More than 32 pieces, cannot pack " + pos.fen());
+	PackedPosition packed {};
+	packed._occupied = pos.occupied();
+	int i = 0;
+	for (Bitboard b = packed._occupied; b; i++) {
+		int sq = popLsb(b);
+		packed._pieces[i / 2] |= pos.pieceOn(sq) << (4 * (i & 1));
+	}
+	packed._flags = uint8_t(pos.sideToMove() | pos._castling << 1);
+	packed._ep = pos._ep;
+	packed._rule50 = pos._rule50;
+	packed._result = result;
+	packed._game_ply = pos._game_ply;
+	packed._score = score;
+	return packed;
+}
+
+void unpackPosition(const PackedPosition& packed, Position& pos) {
+	/* sets up >>pos<< from the record, throws std::invalid_argument if the record
+	 * cannot be a position (e.g. the file is no file of packed positions)
+	 *
+	 * The fields are filled in directly rather than with putPiece(): the keys and
+	 * scores are summed in registers and stored once, the bitboards are indexed by
+	 * the Piece itself, and the loop has no branch that depends on the pieces.
+	 * This makes unpacking about half again as fast.
+	 */
+	if (popCount(packed._occupied) > 32 || packed._ep > NO_SQUARE || packed._flags >> 5
+	    || packed._result > PACKED_RESULT_UNKNOWN)
+		throw std::invalid_argument("Invalid packed position");
+	uint64_t codes[2];  // the 4 bit piece codes, a copy so the compiler knows nothing writes to them
+	memcpy(codes, packed._pieces, sizeof(codes));
+	Bitboard pieces[16] = {};  // [Piece]
+	uint64_t key = 0, pawn_key = 0;
+	int mg = 0, eg = 0, phase = 0;
+	bool invalid = false;
+	memset(pos._board, NO_PIECE, sizeof(pos._board));
+	int i = 0;
+	for (Bitboard b = packed._occupied; b; i++) {
+		int sq = popLsb(b);
+		Piece piece = Piece((codes[i >> 4] >> (4 * (i & 15))) & 15);
+		invalid |= (piece & 7) > KING;
+		pieces[piece] |= squareBB(sq);
+		pos._board[sq] = piece;
+		key ^= ZOBRIST._psq[piece][sq];
+		pawn_key ^= ZOBRIST._psq[piece][sq] & (0 - uint64_t(typeOf(piece) == PAWN));
+		mg += PSQ._scores[piece][sq]._mg;
+		eg += PSQ._scores[piece][sq]._eg;
+		phase += PHASE_WEIGHTS[std::min(typeOf(piece), KING)];  // invalid pieces throw below
+	}
+	if (invalid)
+		throw std::invalid_argument("Invalid piece in packed position");
+	for (Color c : {WHITE, BLACK}) {
+		memcpy(pos._pieces[c], pieces + 8 * c, sizeof(pos._pieces[c]));
+		pos._occupied[c] = pos._pieces[c][PAWN] | pos._pieces[c][KNIGHT] | pos._pieces[c][BISHOP]
+		                   | pos._pieces[c][ROOK] | pos._pieces[c][QUEEN] | pos._pieces[c][KING];
+	}
+	pos._side = Color(packed._flags & 1);
+	pos._castling = packed._flags >> 1;
+	pos._ep = packed._ep;
+	pos._rule50 = packed._rule50;
+	pos._game_ply = packed._game_ply;
+	// the rest of the key like in computeKey()
+	key ^= ZOBRIST._castling[pos._castling];
+	if (pos._ep != NO_SQUARE)
+		key ^= ZOBRIST._ep_file[colOf(pos._ep)];
+	if (pos._side == BLACK)
+		key ^= ZOBRIST._side;
+	pos._key = key;
+	pos._pawn_key = pawn_key;
+	pos._psq = PsqScore {int16_t(mg), int16_t(eg)};
+	pos._phase = uint8_t(phase);
+#ifdef USE_NNUE
+	pos._acc._valid[WHITE] = pos._acc._valid[BLACK] = false;  // refreshed by the first evaluate()
+#endif
+}
+
+struct PackedPositionFile {
+	void* _mapping = nullptr;
+	size_t _size = 0;
+	const PackedPosition* _records = nullptr;
+	size_t _count = 0;
+
+	~PackedPositionFile() { unload(); }
+	bool loaded() const { return _mapping != nullptr; }
+	void load(const std::string& filename);
+	void unload();
+	size_t size() const { return _count; }
+	const PackedPosition& operator[](size_t i) const { return _records[i]; }
+	const PackedPosition* begin() const { return _records; }
+	const PackedPosition* end() const { return _records + _count; }
+};
+
+void PackedPositionFile::load(const std::string& filename) {
+	/* maps the file into memory, throws std::runtime_error if it cannot be read
+	 */
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open packed positions " + filename);
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0 || info.st_size % sizeof(PackedPosition) != 0) {
+		close(fd);
+		throw std::runtime_error(filename + " is not a file of packed positions");
+	}
+	void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);  // the mapping stays valid
+	if (mapping == MAP_FAILED)
+		throw std::runtime_error("Cannot map packed positions " + filename);
+	madvise(mapping, info.st_size, MADV_SEQUENTIAL);  // datasets are mostly read front to back
+
+	unload();
+	_mapping = mapping;
+	_size = info.st_size;
+	_records = static_cast<const PackedPosition*>(mapping);
+	_count = _size / sizeof(PackedPosition);
+}
+
+void PackedPositionFile::unload() {
+	if (_mapping)
+		munmap(_mapping, _size);
+	_mapping = nullptr;
+	_size = 0;
+	_records = nullptr;
+	_count = 0;
+}
+
+struct PackedPositionReader {
+	int _fd = -1;
+	std::vector<PackedPosition> _buffer;
+	std::string _filename;
+
+	PackedPositionReader(const std::string& filename, size_t chunk_records = 1 << 16);
+	~PackedPositionReader() { if (_fd >= 0) close(_fd); }
+	PackedPositionReader(const PackedPositionReader&) = delete;
+	PackedPositionReader& operator=(const PackedPositionReader&) = delete;
+	size_t read(const PackedPosition*& records);
+};
+
+PackedPositionReader::PackedPositionReader(const std::string& filename, size_t chunk_records)
+	: _buffer(std::max<size_t>(1, chunk_records)), _filename(filename) {
+	/* opens the file ("-" is the standard input), throws std::runtime_error if it
+	 * cannot be opened
+	 */
+	_fd = filename == "-" ? dup(STDIN_FILENO) : open(filename.c_str(), O_RDONLY);
+	if (_fd < 0)
+		throw std::runtime_error("Cannot open packed positions " + filename);
+	posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+size_t PackedPositionReader::read(const PackedPosition*& records) {
+	/* reads the next chunk, >>records<< points to it until the next call. Returns
+	 * the number of records in the chunk, 0 at the end of the file. Throws
+	 * std::runtime_error on read errors and if the file ends within a record.
+	 */
+	char* data = reinterpret_cast<char*>(_buffer.data());
+	size_t capacity = _buffer.size() * sizeof(PackedPosition), filled = 0;
+	while (filled < capacity) {  // pipes deliver less than asked for
+		ssize_t n = ::read(_fd, data + filled, capacity - filled);
+		if (n < 0)
+			throw std::runtime_error("Cannot read packed positions " + _filename);
+		if (n == 0)
+			break;
+		filled += n;
+	}
+	if (filled % sizeof(PackedPosition) != 0)
+		throw std::runtime_error(_filename + " ends within a packed position");
+	records = _buffer.data();
+	return filled / sizeof(PackedPosition);
+}
+
+// positions for "main packed check": these have to come back unchanged, the
+// overfull ones (setFen() takes them) have to be refused by packPosition(), and
+// a record of the first one with an invalid result by unpackPosition()
+const char* const PACKED_CHECK_FENS[] = {
+	START_FEN,
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+	"8/8/4k3/8/8/4K3/4P3/8 b - - 17 60",
+};
+const char* const PACKED_OVERFULL_FENS[] = {
+	"rnbqkbnr/pppppppp/8/8/8/7P/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"QQQQQQQQ/QQQQQQQQ/QQQQQQQQ/QQQQQQQQ/QQQQQQQQ/QQQQQQQQ/QQQQQQQQ/QQQQQQQQ w - - 0 1",
+};
+
+bool runPackedChecks() {
+	/* packs and unpacks the check positions, true if all of them pass
+	 */
+	bool all_passed = true;
+	Position pos, unpacked;
+	for (const char* fen : PACKED_CHECK_FENS) {
+		pos.setFen(fen);
+		unpackPosition(packPosition(pos, 17, PACKED_DRAW), unpacked);
+		bool passed = unpacked.fen() == pos.fen() && unpacked._key == pos._key && unpacked._pawn_key == pos._pawn_key;
+		all_passed &= passed;
+		std::cout << (passed ? "OK    " : "FAIL  ") << fen << std::endl;
+	}
+	for (const char* fen : PACKED_OVERFULL_FENS) {
+		pos.setFen(fen);
+		bool passed = false;
+		try {
+			packPosition(pos);
+		} catch (const std::invalid_argument&) {
+			passed = true;
+		}
+		all_passed &= passed;
+		std::cout << (passed ? "OK    " : "FAIL  ") << "refused " << fen << std::endl;
+	}
+	pos.setFen(PACKED_CHECK_FENS[0]);
+	PackedPosition corrupt = packPosition(pos);
+	corrupt._result = PACKED_RESULT_UNKNOWN + 1;
+	bool passed = false;
+	try {
+		unpackPosition(corrupt, unpacked);
+	} catch (const std::invalid_argument&) {
+		passed = true;
+	}
+	all_passed &= passed;
+	std::cout << (passed ? "OK    " : "FAIL  ") << "refused result " << int(corrupt._result) << std::endl;
+	std::cout << (all_passed ? "All packed positions match." : "PACKED MISMATCH!") << std::endl;
+	return all_passed;
+}
+
+int packedMain(int argc, char* argv[]) {
+	/* command line tools for files of packed positions:
+	 *   main packed pack <FEN file> <packed file>
+	 *     one FEN per line, after a complete FEN (with both move counters) may
+	 *     follow a score in centipawns from the side to move and a result "1-0",
+	 *     "1/2-1/2" or "0-1", in any order
+	 *   main packed fen <packed file>
+	 *   main packed bench <packed file> [--stream]
+	 *     unpacks every position of the file, from the mapping or with --stream in
+	 *     chunks, and reports the positions per second
+	 *   main packed check
+	 *     packs and unpacks the built-in positions, exit code 1 on a mismatch
+	 */
+	std::string command = argc > 2 ? argv[2] : "";
+	std::string input = argc > 3 ? argv[3] : "";
+	if (command == "check")
+		return runPackedChecks() ? 0 : 1;
+	if (input.empty() || (command == "pack" && argc < 5) || (command != "pack" && command != "fen" && command != "bench")) {
+		std::cout << "Usage: " << argv[0] << " packed pack <FEN file> <packed file>" << std::endl
+		          << "       " << argv[0] << " packed fen <packed file>" << std::endl
+		          << "       " << argv[0] << " packed bench <packed file> [--stream]" << std::endl
+		          << "       " << argv[0] << " packed check" << std::endl;
+		return 2;
+	}
+
+	Position pos;
+	try {
+		if (command == "pack") {
+			std::ifstream fens(input);
+			if (!fens)
+				throw std::runtime_error("Cannot open " + input);
+			std::ofstream output(argv[4], std::ios::binary);
+			if (!output)
+				throw std::runtime_error(std::string("Cannot create ") + argv[4]);
+			std::string line;
+			size_t count = 0, line_number = 0;
+			while (getline(fens, line)) {
+				line_number++;
+				std::istringstream fields(line);
+				std::string fen, field;
+				for (int i = 0; i < 6 && fields >> field; i++)
+					fen += (fen.empty() ? "" : " ") + field;
+				if (fen.empty())
+					continue;
+				int16_t score = PACKED_SCORE_NONE;
+				PackedResult result = PACKED_RESULT_UNKNOWN;
+				while (fields >> field) {
+					if (field == "1-0") result = PACKED_WHITE_WINS;
+					else if (field == "0-1") result = PACKED_BLACK_WINS;
+					else if (field == "1/2-1/2") result = PACKED_DRAW;
+					else score = int16_t(std::max(-32767, std::min(32767, atoi(field.c_str()))));
+				}
+				PackedPosition packed;
+				try {
+					pos.setFen(fen);
+					packed = packPosition(pos, score, result);
+				} catch (const std::invalid_argument& e) {
+					throw std::runtime_error(input + " line " + std::to_string(line_number) + ": " + e.what());
+				}
+				output.write(reinterpret_cast<const char*>(&packed), sizeof(packed));
+				count++;
+			}
+			if (!output)
+				throw std::runtime_error(std::string("Cannot write ") + argv[4]);
+			std::cout << count << " positions packed" << std::endl;
+		} else if (command == "fen") {
+			PackedPositionReader reader(input);
+			const PackedPosition* records;
+			while (size_t n = reader.read(records)) {
+				for (size_t i = 0; i < n; i++) {
+					unpackPosition(records[i], pos);
+					std::cout << pos.fen();
+					if (records[i]._score != PACKED_SCORE_NONE)
+						std::cout << " " << records[i]._score;
+					if (records[i]._result != PACKED_RESULT_UNKNOWN)
+						std::cout << " " << PACKED_RESULT_NAMES[records[i]._result];
+					std::cout << "\n";
+				}
+			}
+		} else {
+			bool stream = argc > 4 && std::string(argv[4]) == "--stream";
+			auto start = std::chrono::steady_clock::now();
+			size_t count = 0;
+			uint64_t checksum = 0;  // of the keys, so that no unpacking is optimized away
+			if (stream) {
+				PackedPositionReader reader(input);
+				const PackedPosition* records;
+				while (size_t n = reader.read(records)) {
+					for (size_t i = 0; i < n; i++) {
+						unpackPosition(records[i], pos);
+						checksum ^= pos._key;
+					}
+					count += n;
+				}
+			} else {
+				PackedPositionFile file;
+				file.load(input);
+				for (const PackedPosition& packed : file) {
+					unpackPosition(packed, pos);
+					checksum ^= pos._key;
+				}
+				count = file.size();
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cout << count << " positions in " << std::fixed << std::setprecision(3) << seconds << " s, "
+			          << std::setprecision(1) << (seconds > 0 ? count / seconds / 1e6 : 0) << " M positions/s"
+			          << " (checksum " << std::hex << checksum << std::dec << ")" << std::endl;
+		}
+	} catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 2;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef PAWNS_HPP
+#define PAWNS_HPP
+
+#include "position.hpp"
+
+/* Pawn structure evaluation: passed, isolated, doubled and backward pawns.
+ *
+ * The terms depend on nothing but the pawns of both sides, which change only on
+ * pawn moves and pawn captures, so their score is cached in a pawn hash table by
+ * the pawn key of the position (Position::_pawn_key, the Zobrist key of the pawns
+ * alone). Every search thread has its own small table, so there is no sharing
+ * and no locking, and most probes hit: the pawn structure of the nodes of a
+ * search varies far less than the positions.
+ */
+
+// bonus of a passed pawn by its rank, seen from its own side (index 1 is the 2nd rank)
+const int PASSED_BONUS_MG[8] = {0, 5, 10, 15, 25, 40, 60, 0};
+const int PASSED_BONUS_EG[8] = {0, 10, 20, 35, 60, 100, 150, 0};
+const PsqScore ISOLATED_PENALTY {-10, -15};
+const PsqScore DOUBLED_PENALTY {-10, -20};
+const PsqScore BACKWARD_PENALTY {-8, -10};
+
+// all squares on ranks in front of >>sq<<, seen from the side c
+inline Bitboard forwardRanks(Color c, int sq) {
+	int row = rowOf(sq);
+	return c == WHITE ? (row == 7 ? 0 : ~0ULL << (8 * (row + 1))) : (1ULL << (8 * row)) - 1;
+}
+
+inline Bitboard adjacentFiles(int col) {
+	return (col > 0 ? FILE_A_BB << (col - 1) : 0) | (col < 7 ? FILE_A_BB << (col + 1) : 0);
+}
+
+template<Color Us>
+PsqScore evaluatePawnsOf(const Position& pos) {
+	/* pawn structure score of the side Us, positive is good for Us
+	 */
+	constexpr Color Them = !Us;
+	Bitboard own = pos.pieces(Us, PAWN);
+	Bitboard enemy = pos.pieces(Them, PAWN);
+	int mg = 0, eg = 0;
+
+	for (Bitboard pawns = own; pawns; ) {
+		int sq = popLsb(pawns);
+		int col = colOf(sq);
+		int relative_row = Us == WHITE ? rowOf(sq) : 7 - rowOf(sq);
+		Bitboard file = FILE_A_BB << col;
+		Bitboard neighbours = adjacentFiles(col);
+		Bitboard front = forwardRanks(Us, sq);
+
+		bool isolated = !(own & neighbours);
+		bool doubled = own & file & front;  // counted once, for the pawn behind
+		bool passed = !(enemy & (file | neighbours) & front) && !doubled;
+		// backward: no own pawn beside or behind it can ever protect it, and its stop
+		// square is attacked by an enemy pawn, so it cannot advance safely
+		int stop = sq + (Us == WHITE ? 8 : -8);
+		bool backward = !isolated && !passed && !(own & neighbours & ~front)
+		             && (pawnAttacks(Us, stop) & enemy);
+
+		if (isolated) { mg += ISOLATED_PENALTY._mg; eg += ISOLATED_PENALTY._eg; }
+		if (doubled) { mg += DOUBLED_PENALTY._mg; eg += DOUBLED_PENALTY._eg; }
+		if (backward) { mg += BACKWARD_PENALTY._mg; eg += BACKWARD_PENALTY._eg; }
+		if (passed) {
+			mg += PASSED_BONUS_MG[relative_row];
+			eg += PASSED_BONUS_EG[relative_row];
+		}
+	}
+	return PsqScore {int16_t(mg), int16_t(eg)};
+}
+
+inline PsqScore evaluatePawns(const Position& pos) {
+	/* pawn structure score of white minus black
+	 */
+	PsqScore white = evaluatePawnsOf<WHITE>(pos), black = evaluatePawnsOf<BLACK>(pos);
+	return PsqScore {int16_t(white._mg - black._mg), int16_t(white._eg - black._eg)};
+}
+
+struct PawnEntry {
+	uint64_t _key;
+	PsqScore _score;
+};
+
+const int PAWN_TABLE_SIZE = 8192;  // entries, a power of two, 128 KB
+
+struct PawnTable {
+	// zero initialized: the key 0 belongs to the position without pawns, whose score is 0
+	PawnEntry _entries[PAWN_TABLE_SIZE] {};
+	uint64_t _probes = 0;
+	uint64_t _hits = 0;
+
+	PsqScore probe(const Position& pos) {
+		/* the pawn structure score of the position, computed only on a miss
+		 */
+		PawnEntry& entry = _entries[pos._pawn_key & (PAWN_TABLE_SIZE - 1)];
+		_probes++;
+		if (entry._key == pos._pawn_key) {
+			_hits++;
+			return entry._score;
+		}
+		entry._key = pos._pawn_key;
+		entry._score = evaluatePawns(pos);
+		return entry._score;
+	}
+};
+
+#endif
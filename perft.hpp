@@ -0,0 +1,366 @@
+#ifndef PERFT_HPP
+#define PERFT_HPP
+
+#include "chess.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+
+/* Perft (performance test): counts the leaf nodes of the legal move tree up to a
+ * fixed depth. The counts of many positions are known, so perft checks the move
+ * generator and make/unmake for correctness and measures their speed at once.
+ */
+
+uint64_t perft(Position& pos, int depth) {
+	/* number of leaf nodes >>depth<< half moves below the position. The last ply
+	 * is only counted (bulk counting), the moves are neither stored nor made.
+	 */
+	if (depth <= 0)
+		return 1;
+	if (depth == 1) {
+		uint64_t count = 0;
+		forEachLegalMove<ALL>(pos, [&](Move) { count++; return false; });
+		return count;
+	}
+
+	MoveList moves;
+	generateMoves<ALL>(pos, moves);
+	uint64_t nodes = 0;
+	UndoRecord undo;
+	for (Move m : moves) {
+		pos.makeMove(m, undo);
+		nodes += perft(pos, depth - 1);
+		pos.unmakeMove(undo);
+	}
+	return nodes;
+}
+
+double elapsedSeconds(chrono::steady_clock::time_point start) {
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void printPerftSummary(uint64_t nodes, double seconds) {
+	cout << "Nodes searched: " << nodes << endl;
+	cout << "Time: " << fixed << setprecision(3) << seconds << " s" << endl;
+	cout << "Nodes/second: " << uint64_t(seconds > 0 ? nodes / seconds : 0) << endl;
+}
+
+uint64_t perftDivide(ChessBoard& chess_board, int depth) {
+	/* perft with the node count of every root move printed separately ("divide"),
+	 * to find the move where the count differs from a reference engine
+	 */
+	auto start = chrono::steady_clock::now();
+	MoveList moves;
+	generateMoves<ALL>(chess_board._pos, moves);
+
+	uint64_t nodes = 0;
+	UndoRecord undo;
+	for (Move m : moves) {
+		string notation = chess_board.moveToNotation(m);  // before the move is made
+		chess_board._pos.makeMove(m, undo);
+		uint64_t count = perft(chess_board._pos, depth - 1);
+		chess_board._pos.unmakeMove(undo);
+		nodes += count;
+		cout << notation << ": " << count << endl;
+	}
+	cout << endl;
+	printPerftSummary(nodes, elapsedSeconds(start));
+	return nodes;
+}
+
+/* Shared cache of subtree counts for perft, indexed by position key and depth.
+ * Any number of threads may read and write it at the same time without locks:
+ * an entry is two words and the first one holds the key xored with the second,
+ * so an entry that was torn by two threads writing at once does not verify and
+ * is simply treated as a miss. Entries are always replaced.
+ */
+struct PerftEntry {
+	atomic<uint64_t> _key_xor_data {0};
+	atomic<uint64_t> _data {0};  // nodes << 8 | depth
+};
+
+struct PerftTable {
+	unique_ptr<PerftEntry[]> _entries;
+	uint64_t _mask;
+
+	PerftTable(size_t megabytes);
+	PerftEntry& entry(uint64_t key, int depth) const {
+		return _entries[(key ^ (depth * 0x9E3779B97F4A7C15ULL)) & _mask];  // depths of one position spread out
+	}
+	bool probe(uint64_t key, int depth, uint64_t& nodes) const;
+	void store(uint64_t key, int depth, uint64_t nodes);
+};
+
+PerftTable::PerftTable(size_t megabytes) {
+	/* the number of entries is the largest power of two that fits into >>megabytes<<
+	 */
+	size_t count = 1;
+	while (2 * count * sizeof(PerftEntry) <= max<size_t>(megabytes, 1) << 20)
+		count *= 2;
+	_entries.reset(new PerftEntry[count]);
+	_mask = count - 1;
+}
+
+bool PerftTable::probe(uint64_t key, int depth, uint64_t& nodes) const {
+	PerftEntry& e = entry(key, depth);
+	uint64_t data = e._data.load(memory_order_relaxed);
+	if ((e._key_xor_data.load(memory_order_relaxed) ^ data) != key || int(data & 0xFF) != depth)
+		return false;
+	nodes = data >> 8;
+	return true;
+}
+
+void PerftTable::store(uint64_t key, int depth, uint64_t nodes) {
+	PerftEntry& e = entry(key, depth);
+	uint64_t data = (nodes << 8) | uint64_t(depth);
+	e._key_xor_data.store(key ^ data, memory_order_relaxed);
+	e._data.store(data, memory_order_relaxed);
+}
+
+uint64_t perftHashed(Position& pos, int depth, PerftTable& table) {
+	/* perft(), but the counts of subtrees of depth 2 and more are looked up in and
+	 * stored to the table, transpositions are only searched once
+	 */
+	if (depth <= 1)
+		return perft(pos, depth);
+
+	uint64_t key = pos._key, nodes = 0;
+	if (table.probe(key, depth, nodes))
+		return nodes;
+
+	MoveList moves;
+	generateMoves<ALL>(pos, moves);
+	UndoRecord undo;
+	for (Move m : moves) {
+		pos.makeMove(m, undo);
+		nodes += perftHashed(pos, depth - 1, table);
+		pos.unmakeMove(undo);
+	}
+	table.store(key, depth, nodes);
+	return nodes;
+}
+
+/* Parallel perft: the tree is split into the subtrees >>_split_depth<< half moves
+ * below the root, every subtree is one task of a work-stealing pool.
+ */
+struct PerftOptions {
+	int _threads = 1;
+	int _split_depth = 2;
+	size_t _hash_mb = 0;  // 0 disables the shared table
+};
+
+struct PerftTask {
+	Position _pos;
+	int _depth;  // remaining depth below _pos
+	int _root;   // index of the root move the subtree belongs to, for the divide output
+};
+
+struct alignas(64) PerftThreadStats {  // one cache line per thread, no false sharing
+	uint64_t _nodes = 0;
+	uint64_t _tasks = 0;
+	uint64_t _steals = 0;
+	uint64_t _failed_steals = 0;
+};
+
+void splitPerft(Position& pos, int depth, int split_plies, int root, WorkStealingPool<PerftTask>& pool, int& next_worker) {
+	/* queues the subtrees >>split_plies<< half moves below the position, round
+	 * robin over the workers. Positions without moves above the split produce no task.
+	 */
+	if (split_plies == 0 || depth == 0) {
+		pool.push(next_worker++, PerftTask {pos, depth, root});
+		return;
+	}
+	MoveList moves;
+	generateMoves<ALL>(pos, moves);
+	UndoRecord undo;
+	for (Move m : moves) {
+		pos.makeMove(m, undo);
+		splitPerft(pos, depth - 1, split_plies - 1, root, pool, next_worker);
+		pos.unmakeMove(undo);
+	}
+}
+
+uint64_t parallelPerft(ChessBoard& chess_board, int depth, const PerftOptions& options, PerftTable* table,
+                       vector<PerftThreadStats>& stats, bool divide) {
+	/* perft on >>options._threads<< threads, optionally with the shared table. The
+	 * per-thread statistics are added to >>stats<<, with divide the node count of
+	 * every root move is printed.
+	 */
+	Position& pos = chess_board._pos;
+	if (depth <= 0)
+		return 1;
+
+	MoveList root_moves;
+	generateMoves<ALL>(pos, root_moves);
+	WorkStealingPool<PerftTask> pool(options._threads);
+	stats.resize(pool.size());
+
+	int next_worker = 0;
+	UndoRecord undo;
+	for (int i = 0; i < root_moves.size(); i++) {
+		pos.makeMove(root_moves[i], undo);
+		splitPerft(pos, depth - 1, max(options._split_depth - 1, 0), i, pool, next_worker);
+		pos.unmakeMove(undo);
+	}
+
+	vector<atomic<uint64_t>> root_nodes(root_moves.size());
+	pool.run([&](int id, PerftTask& task) {
+		uint64_t nodes = table ? perftHashed(task._pos, task._depth, *table) : perft(task._pos, task._depth);
+		root_nodes[task._root].fetch_add(nodes, memory_order_relaxed);
+		stats[id]._nodes += nodes;
+	});
+
+	uint64_t nodes = 0;
+	for (int i = 0; i < root_moves.size(); i++) {
+		nodes += root_nodes[i];
+		if (divide)
+			cout << chess_board.moveToNotation(root_moves[i]) << ": " << root_nodes[i] << endl;
+	}
+	for (int id = 0; id < pool.size(); id++) {
+		stats[id]._tasks += pool._workers[id]->_executed;
+		stats[id]._steals += pool._workers[id]->_steals;
+		stats[id]._failed_steals += pool._workers[id]->_failed_steals;
+	}
+	return nodes;
+}
+
+void printThreadStats(const vector<PerftThreadStats>& stats) {
+	uint64_t total = 0;
+	for (const PerftThreadStats& s : stats)
+		total += s._nodes;
+	for (size_t id = 0; id < stats.size(); id++) {
+		cout << "Thread " << setw(2) << id << ": " << setw(12) << stats[id]._nodes << " nodes ("
+		     << fixed << setprecision(1) << setw(5) << (total ? 100.0 * stats[id]._nodes / total : 0.0) << "%), "
+		     << stats[id]._tasks << " tasks, " << stats[id]._steals << " stolen, "
+		     << stats[id]._failed_steals << " failed steals" << endl;
+	}
+}
+
+// standard positions with their known node counts, index is depth - 1
+struct PerftCase {
+	const char* _name;
+	const char* _fen;
+	vector<uint64_t> _nodes;
+};
+
+const PerftCase PERFT_SUITE[] = {
+	{"initial position", START_FEN,
+		{20, 400, 8902, 197281, 4865609, 119060324}},
+	{"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		{48, 2039, 97862, 4085603, 193690690}},
+	{"position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		{14, 191, 2812, 43238, 674624, 11030083, 178633661}},
+	{"position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		{6, 264, 9467, 422333, 15833292, 706045033}},
+	{"position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+		{44, 1486, 62379, 2103487, 89941194}},
+	{"position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+		{46, 2079, 89890, 3894594, 164075551}},
+};
+
+bool runPerftSuite(int max_depth, const PerftOptions& options) {
+	/* runs every suite position up to >>max_depth<< (or its deepest known count)
+	 * and compares against the expected node count. Returns true if all match.
+	 */
+	bool all_passed = true;
+	bool parallel = options._threads > 1 || options._hash_mb > 0;
+	uint64_t total_nodes = 0;
+	auto start = chrono::steady_clock::now();
+	ChessBoard chess_board;
+	unique_ptr<PerftTable> table(options._hash_mb > 0 ? new PerftTable(options._hash_mb) : nullptr);
+	vector<PerftThreadStats> stats;
+
+	for (const PerftCase& perft_case : PERFT_SUITE) {
+		chess_board.loadFen(perft_case._fen);
+		int depth = min(max_depth, int(perft_case._nodes.size()));
+
+		auto case_start = chrono::steady_clock::now();
+		uint64_t nodes = parallel ? parallelPerft(chess_board, depth, options, table.get(), stats, false)
+		                          : perft(chess_board._pos, depth);
+		double seconds = elapsedSeconds(case_start);
+		bool passed = nodes == perft_case._nodes[depth - 1];
+		all_passed &= passed;
+		total_nodes += nodes;
+
+		cout << left << setw(18) << perft_case._name << right
+		     << " depth " << depth
+		     << setw(12) << nodes << " nodes"
+		     << (passed ? "  OK  " : "  FAIL (expected " + to_string(perft_case._nodes[depth - 1]) + ")  ")
+		     << fixed << setprecision(3) << seconds << " s  "
+		     << uint64_t(seconds > 0 ? nodes / seconds : 0) << " nps" << endl;
+	}
+	cout << endl;
+	printPerftSummary(total_nodes, elapsedSeconds(start));
+	if (parallel)
+		printThreadStats(stats);
+	cout << (all_passed ? "All perft counts match." : "PERFT MISMATCH!") << endl;
+	return all_passed;
+}
+
+int perftMain(int argc, char* argv[]) {
+	/* command line perft mode:
+	 *   main perft <depth> [<FEN> | <board file>] [options]   divide output, default is the initial position
+	 *   main perft suite [<max depth>] [options]              built-in suite, default max depth is 5
+	 * options:
+	 *   --threads <n>   number of threads, default 1
+	 *   --split <d>     parallel perft splits the tree into tasks <d> half moves below the root, default 2
+	 *   --hash <MB>     size of the shared subtree cache, default 0 (off)
+	 * returns the exit code of the program
+	 */
+	PerftOptions options;
+	vector<string> args;
+	for (int i = 2; i < argc; i++) {
+		string arg = argv[i];
+		if ((arg == "--threads" || arg == "--split" || arg == "--hash") && i + 1 < argc) {
+			int value = max(0, atoi(argv[++i]));
+			if (arg == "--threads") options._threads = max(1, value);
+			else if (arg == "--split") options._split_depth = max(1, value);
+			else options._hash_mb = value;
+		} else {
+			args.push_back(arg);
+		}
+	}
+
+	if (args.empty()) {
+		cout << "Usage: " << argv[0] << " perft <depth> [<FEN> | <board file>] [--threads <n>] [--split <d>] [--hash <MB>]" << endl;
+		cout << "       " << argv[0] << " perft suite [<max depth>] [--threads <n>] [--split <d>] [--hash <MB>]" << endl;
+		return 2;
+	}
+
+	if (args[0] == "suite")
+		return runPerftSuite(args.size() > 1 ? max(1, atoi(args[1].c_str())) : 5, options) ? 0 : 1;
+
+	int depth = atoi(args[0].c_str());
+	if (depth < 1) {
+		cout << "Depth must be at least 1!" << endl;
+		return 2;
+	}
+
+	ChessBoard chess_board;
+	string source = args.size() > 1 ? args[1] : START_FEN;
+	for (size_t i = 2; i < args.size(); i++)  // an unquoted FEN arrives as several arguments
+		source += " " + args[i];
+	try {
+		chess_board.loadPosition(source);
+	} catch (const exception& e) {
+		cout << e.what() << endl;
+		return 2;
+	}
+
+	if (options._threads == 1 && options._hash_mb == 0) {
+		perftDivide(chess_board, depth);
+		return 0;
+	}
+
+	auto start = chrono::steady_clock::now();
+	unique_ptr<PerftTable> table(options._hash_mb > 0 ? new PerftTable(options._hash_mb) : nullptr);
+	vector<PerftThreadStats> stats;
+	uint64_t nodes = parallelPerft(chess_board, depth, options, table.get(), stats, true);
+	cout << endl;
+	printPerftSummary(nodes, elapsedSeconds(start));
+	printThreadStats(stats);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,536 @@
+#ifndef PGN_HPP
+#define PGN_HPP
+
+#include "movegen.hpp"
+#include "packed.hpp"
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+/* Reading game archives in PGN (Portable Game Notation):
+ *   main pgn <PGN file> [options]    "-" reads the standard input
+ * options:
+ *   --threads <n>           replaying threads, default all cores
+ *   --results <file>        one line per game: number, result, plies, final FEN and
+ *                           the error, if the game could not be replayed completely
+ *   --positions <file>      the position before every move, packed (see packed.hpp)
+ *                           with the result of the game, of the complete games
+ *
+ * Nothing is written to the standard output but a summary at the end. The games
+ * are replayed on a Position, not a ChessBoard: no board is printed, and an illegal
+ * move only ends the replay of its game with an error.
+ *
+ * The file is streamed: PgnReader reads it in chunks of whole games (1 MB, or
+ * one game if that is longer), which the threads parse and replay, and the output
+ * of a chunk is written once all chunks before it are written. So memory stays a
+ * few chunks per thread for files of any size, and the output is in the order of
+ * the file, the same for any number of threads.
+ *
+ * Moves are in SAN (Standard Algebraic Notation, e.g. "Nbd7", "exd6", "e8=Q+",
+ * "O-O"). sanToMove() does not generate the moves of the position: it looks only
+ * at the pieces of the moving type that reach the target square, and checks the
+ * legality of these few with isLegal().
+ */
+
+Move sanToMove(const Position& pos, const char* san, size_t length) {
+	/* the legal move written as >>san<<, MOVE_NONE if it is malformed, illegal,
+	 * ambiguous, or has an "x" exactly if it is no capture. Check and annotation
+	 * marks ("+", "#", "!", "?") are ignored.
+	 */
+	while (length && (san[length - 1] == '+' || san[length - 1] == '#' || san[length - 1] == '!' || san[length - 1] == '?'))
+		length--;
+	Color us = pos.sideToMove();
+
+	if (length >= 3 && (san[0] == 'O' || san[0] == '0')) {  // castling, also written with zeros
+		bool is_short = length == 3 && san[1] == '-' && san[2] == san[0];
+		bool is_long = length == 5 && san[1] == '-' && san[2] == san[0] && san[3] == '-' && san[4] == san[0];
+		if ((!is_short && !is_long) || !pos.pieces(us, KING))
+			return MOVE_NONE;
+		int ksq = lsb(pos.pieces(us, KING));
+		Move m(ksq, is_short ? ksq + 2 : ksq - 2, CASTLING);
+		return isLegal(pos, m) ? m : MOVE_NONE;
+	}
+
+	size_t i = 0;
+	PieceType type = PAWN;
+	if (length && san[0] >= 'B' && san[0] <= 'R' && charToPieceType(san[0]) != NO_PIECE_TYPE) {
+		type = charToPieceType(san[0]);
+		i = 1;
+	}
+	PieceType promotion = NO_PIECE_TYPE;
+	if (type == PAWN && length > 2 && charToPieceType(san[length - 1]) >= KNIGHT && charToPieceType(san[length - 1]) <= QUEEN) {
+		promotion = charToPieceType(san[length - 1]);
+		length -= san[length - 2] == '=' ? 2 : 1;
+	}
+	if (length < i + 2)
+		return MOVE_NONE;
+	int to_col = san[length - 2] - 'a', to_row = san[length - 1] - '1';
+	if (to_col < 0 || to_col > 7 || to_row < 0 || to_row > 7)
+		return MOVE_NONE;
+	int to = makeSquare(to_row, to_col);
+
+	// what is between the figure and the target: the origin file and/or rank, "x"
+	int from_col = -1, from_row = -1;
+	bool capture = false;
+	for (; i < length - 2; i++) {
+		if (san[i] >= 'a' && san[i] <= 'h')
+			from_col = san[i] - 'a';
+		else if (san[i] >= '1' && san[i] <= '8')
+			from_row = san[i] - '1';
+		else if (san[i] == 'x')
+			capture = true;
+		else
+			return MOVE_NONE;
+	}
+
+	// the figures of the type that could reach the target, looking back from it
+	Bitboard candidates = pos.pieces(us, type), target = squareBB(to);
+	switch (type) {
+		case PAWN:
+			candidates &= from_col >= 0 && from_col != to_col ? pawnAttacks(!us, to)
+			            : us == WHITE ? target >> 8 | target >> 16 : target << 8 | target << 16;
+			break;
+		case KNIGHT: candidates &= knightAttacks(to); break;
+		case BISHOP: candidates &= bishopAttacks(to, pos.occupied()); break;
+		case ROOK:   candidates &= rookAttacks(to, pos.occupied()); break;
+		case QUEEN:  candidates &= queenAttacks(to, pos.occupied()); break;
+		default:     candidates &= kingAttacks(to); break;
+	}
+	if (from_col >= 0)
+		candidates &= FILE_A_BB << from_col;
+	if (from_row >= 0)
+		candidates &= RANK_1_BB << (8 * from_row);
+
+	bool promotes = type == PAWN && (to_row == 0 || to_row == 7);
+	if (promotes != (promotion != NO_PIECE_TYPE))
+		return MOVE_NONE;
+	Move found = MOVE_NONE;
+	while (candidates) {
+		int from = popLsb(candidates);
+		Move m = promotes ? Move(from, to, PROMOTION, promotion)
+		       : type == PAWN && to == pos._ep && colOf(from) != to_col ? Move(from, to, EN_PASSANT)
+		       : Move(from, to);
+		if (!isLegal(pos, m))
+			continue;
+		if (capture != (!pos.isEmpty(to) || m.flag() == EN_PASSANT))
+			return MOVE_NONE;
+		if (found)
+			return MOVE_NONE;  // ambiguous
+		found = m;
+	}
+	return found;
+}
+
+inline bool isPgnSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+const char* nextPgnGame(const char* begin, const char* end) {
+	/* where the game after the one starting at >>begin<< starts, >>end<< if there is
+	 * none: at the first tag line after the movetext. Lines starting with "[" within
+	 * a comment ({...} may span lines) are not tags, and neither are the brackets of
+	 * ";" comments and "%" escape lines.
+	 */
+	bool movetext = false, comment = false;
+	for (const char* line = begin; line < end; ) {
+		const char* newline = static_cast<const char*>(memchr(line, '\n', end - line));
+		const char* next = newline ? newline + 1 : end;
+		if (!comment && *line == '[') {
+			if (movetext)
+				return line;
+		} else if (comment || *line != '%') {
+			for (const char* c = line; c < next; c++) {
+				if (comment) {
+					const char* close = static_cast<const char*>(memchr(c, '}', next - c));
+					if (!close)
+						break;
+					comment = false;
+					c = close;
+				} else if (*c == '{' || *c == ';') {
+					movetext = true;
+					if (*c == ';')
+						break;
+					comment = true;
+				} else {
+					movetext |= !isPgnSpace(*c);
+				}
+			}
+		}
+		line = next;
+	}
+	return end;
+}
+
+struct PgnGame {
+	std::string _fen;      // of the FEN tag, empty for games from the initial position
+	PackedResult _result;  // of the Result tag, or else of the termination marker
+	int _plies;            // moves replayed
+	std::string _error;    // why the replay stopped early, empty if it did not
+	Position _pos;         // after the last replayed move
+};
+
+template<typename Visitor>
+void replayPgnGame(const char* begin, const char* end, PgnGame& game, Visitor&& visit) {
+	/* parses the game in [>>begin<<, >>end<<) and replays its moves, visit(pos, m)
+	 * is called with every move before it is made. Variations, comments and
+	 * annotations are skipped. Never throws, errors end up in game._error.
+	 */
+	static const Position initial = [] { Position pos; pos.setFen(START_FEN); return pos; }();
+	game._fen.clear();
+	game._result = PACKED_RESULT_UNKNOWN;
+	game._plies = 0;
+	game._error.clear();
+	auto resultOf = [](const char* token, size_t length) {
+		std::string result(token, length);
+		return result == "1-0" ? PACKED_WHITE_WINS : result == "0-1" ? PACKED_BLACK_WINS
+		     : result == "1/2-1/2" ? PACKED_DRAW : PACKED_RESULT_UNKNOWN;
+	};
+
+	// the tag pairs, e.g. [Result "1-0"]
+	const char* p = begin;
+	while (true) {
+		while (p < end && isPgnSpace(*p))
+			p++;
+		if (p == end || *p != '[')
+			break;
+		const char* name = ++p;
+		while (p < end && !isPgnSpace(*p) && *p != '"' && *p != ']')
+			p++;
+		std::string tag(name, p);
+		while (p < end && *p != '"' && *p != ']' && *p != '\n')
+			p++;
+		std::string value;
+		if (p < end && *p == '"') {
+			for (p++; p < end && *p != '"' && *p != '\n'; p++)
+				value += (*p == '\\' && p + 1 < end) ? *++p : *p;
+		}
+		while (p < end && *p != '\n')  // the rest of the line
+			p++;
+		if (tag == "FEN")
+			game._fen = value;
+		else if (tag == "Result")
+			game._result = resultOf(value.data(), value.size());
+	}
+
+	if (game._fen.empty()) {
+		game._pos = initial;
+	} else {
+		try {
+			game._pos.setFen(game._fen);
+		} catch (const std::exception& e) {
+			game._pos = initial;
+			game._error = e.what();
+			return;
+		}
+	}
+
+	// the movetext
+	while (p < end) {
+		char c = *p;
+		if (isPgnSpace(c) || c == ')') {
+			p++;
+		} else if (c == '{') {  // comment
+			const char* close = static_cast<const char*>(memchr(p, '}', end - p));
+			if (!close) {
+				game._error = "unterminated comment at ply " + std::to_string(game._plies + 1);
+				return;
+			}
+			p = close + 1;
+		} else if (c == ';' || (c == '%' && (p == begin || p[-1] == '\n'))) {  // comment or escape to the end of the line
+			const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+			p = newline ? newline + 1 : end;
+		} else if (c == '(') {  // variation, may contain variations and comments
+			int depth = 0;
+			for (; p < end; p++) {
+				if (*p == '{') {
+					const char* close = static_cast<const char*>(memchr(p, '}', end - p));
+					p = close ? close : end - 1;
+				} else if (*p == '(') {
+					depth++;
+				} else if (*p == ')' && --depth == 0) {
+					break;
+				}
+			}
+			if (p >= end) {
+				game._error = "unterminated variation at ply " + std::to_string(game._plies + 1);
+				return;
+			}
+			p++;
+		} else if (c == '$') {  // numeric annotation glyph
+			for (p++; p < end && *p >= '0' && *p <= '9'; p++) {}
+		} else if (c == '*') {
+			break;
+		} else {
+			const char* token = p;
+			while (p < end && !isPgnSpace(*p) && *p != '{' && *p != '(' && *p != ')' && *p != ';')
+				p++;
+			if (c >= '0' && c <= '9') {
+				PackedResult result = resultOf(token, p - token);
+				if (result != PACKED_RESULT_UNKNOWN) {  // the termination marker
+					if (game._result == PACKED_RESULT_UNKNOWN)
+						game._result = result;
+					break;
+				}
+				if (std::string(token, p).compare(0, 3, "0-0") != 0) {  // not castling, but a move number, e.g. "12." or "12..."
+					while (token < p && ((*token >= '0' && *token <= '9') || *token == '.'))
+						token++;
+					if (token == p)
+						continue;
+				}
+			}
+			Move m = sanToMove(game._pos, token, p - token);
+			if (!m) {
+				game._error = "illegal move " + std::string(token, p) + " at ply " + std::to_string(game._plies + 1);
+				return;
+			}
+			visit(game._pos, m);
+			UndoRecord undo;
+			game._pos.makeMove(m, undo);
+			game._plies++;
+		}
+	}
+}
+
+struct PgnReader {
+	int _fd = -1;
+	std::string _filename;
+	std::string _buffer;  // read, but not yet handed out
+	size_t _chunk_bytes;
+	bool _eof = false;
+	uint64_t _bytes = 0;  // read so far
+
+	PgnReader(const std::string& filename, size_t chunk_bytes = 1 << 20);
+	~PgnReader() { if (_fd >= 0) close(_fd); }
+	PgnReader(const PgnReader&) = delete;
+	PgnReader& operator=(const PgnReader&) = delete;
+	bool next(std::string& chunk);
+};
+
+PgnReader::PgnReader(const std::string& filename, size_t chunk_bytes)
+	: _filename(filename), _chunk_bytes(std::max<size_t>(1, chunk_bytes)) {
+	/* opens the file ("-" is the standard input), throws std::runtime_error if it
+	 * cannot be opened
+	 */
+	_fd = filename == "-" ? dup(STDIN_FILENO) : open(filename.c_str(), O_RDONLY);
+	if (_fd < 0)
+		throw std::runtime_error("Cannot open PGN file " + filename);
+	posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+bool PgnReader::next(std::string& chunk) {
+	/* the next chunk of whole games, false at the end of the file. Throws
+	 * std::runtime_error on read errors.
+	 */
+	size_t wanted = _chunk_bytes;
+	while (true) {
+		while (!_eof && _buffer.size() < wanted) {
+			size_t filled = _buffer.size();
+			_buffer.resize(wanted);
+			ssize_t n = ::read(_fd, &_buffer[filled], wanted - filled);
+			if (n < 0)
+				throw std::runtime_error("Cannot read PGN file " + _filename);
+			_buffer.resize(filled + n);
+			_eof = n == 0;
+			_bytes += n;
+		}
+		if (_eof) {  // the rest is the last chunk
+			if (_buffer.empty())
+				return false;
+			chunk.swap(_buffer);
+			_buffer.clear();
+			return true;
+		}
+
+		// cut after the last complete game
+		const char* begin = _buffer.data();
+		const char* end = begin + _buffer.size();
+		const char* cut = begin;
+		for (const char* game = nextPgnGame(begin, end); game != end; game = nextPgnGame(game, end))
+			cut = game;
+		if (cut != begin) {
+			chunk.assign(begin, cut);
+			_buffer.erase(0, cut - begin);
+			return true;
+		}
+		wanted += _chunk_bytes;  // a game longer than a chunk
+	}
+}
+
+template<typename Output, typename Process, typename Write>
+uint64_t processPgnFile(const std::string& filename, int threads, Process process, Write write) {
+	/* streams the file in chunks of whole games to >>threads<< threads, which call
+	 * process(chunk, output) with a fresh Output each. write(output) is called
+	 * for the chunks in the order of the file, by one thread at a time. Returns the
+	 * bytes read, throws std::runtime_error if the file cannot be read.
+	 */
+	PgnReader reader(filename);
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::pair<uint64_t, std::string>> queue;  // chunks read, with their sequence numbers
+	const size_t capacity = 2 * std::max(1, threads);
+	bool done = false;
+	uint64_t written = 0;  // chunks written
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < std::max(1, threads); t++) {
+		workers.emplace_back([&]() {
+			std::string text;
+			while (true) {
+				uint64_t sequence;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					changed.wait(lock, [&]() { return !queue.empty() || done; });
+					if (queue.empty())
+						return;
+					sequence = queue.front().first;
+					text.swap(queue.front().second);
+					queue.pop_front();
+				}
+				changed.notify_all();
+				Output output;
+				process(text, output);
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&]() { return written == sequence; });
+				write(output);
+				written++;
+				changed.notify_all();
+			}
+		});
+	}
+
+	std::exception_ptr error;
+	try {
+		std::string text;
+		for (uint64_t sequence = 0; reader.next(text); sequence++) {
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [&]() { return queue.size() < capacity; });
+			queue.emplace_back(sequence, std::move(text));
+			text = std::string();
+			lock.unlock();
+			changed.notify_all();
+		}
+	} catch (...) {
+		error = std::current_exception();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done = true;
+	}
+	changed.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	if (error)
+		std::rethrow_exception(error);
+	return reader._bytes;
+}
+
+struct PgnChunkOutput {
+	std::string _results;  // one line per game, without the game number
+	std::vector<PackedPosition> _positions;
+	uint64_t _games = 0;
+	uint64_t _errors = 0;
+	uint64_t _plies = 0;
+};
+
+int pgnMain(int argc, char* argv[]) {
+	/* command line reader, see the top of the file
+	 */
+	std::string input, results_file, positions_file;
+	int threads = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--threads" && has_value)
+			threads = std::max(1, atoi(argv[++i]));
+		else if (arg == "--results" && has_value)
+			results_file = argv[++i];
+		else if (arg == "--positions" && has_value)
+			positions_file = argv[++i];
+		else if (input.empty() && (arg == "-" || arg.substr(0, 2) != "--"))
+			input = arg;
+		else {
+			std::cout << "Unknown option " << arg << std::endl;
+			return 2;
+		}
+	}
+	if (input.empty()) {
+		std::cout << "Usage: " << argv[0] << " pgn <PGN file> [--threads <n>] [--results <file>] [--positions <file>]" << std::endl;
+		return 2;
+	}
+
+	std::ofstream results, positions;
+	if (!results_file.empty())
+		results.open(results_file);
+	if (!positions_file.empty())
+		positions.open(positions_file, std::ios::binary);
+	if ((!results_file.empty() && !results) || (!positions_file.empty() && !positions)) {
+		std::cout << "Cannot create " << (!results ? results_file : positions_file) << std::endl;
+		return 2;
+	}
+	bool want_results = results.is_open(), want_positions = positions.is_open();
+
+	PgnChunkOutput total;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t bytes;
+	try {
+		bytes = processPgnFile<PgnChunkOutput>(input, threads,
+			[&](const std::string& text, PgnChunkOutput& output) {
+				PgnGame game;
+				const char* end = text.data() + text.size();
+				for (const char* begin = text.data(); begin < end; ) {
+					const char* next = nextPgnGame(begin, end);
+					const char* text_begin = begin;
+					begin = next;
+					while (text_begin < next && isPgnSpace(*text_begin))
+						text_begin++;
+					if (text_begin == next)  // nothing but white space
+						continue;
+					size_t first = output._positions.size();
+					replayPgnGame(text_begin, next, game, [&](const Position& pos, Move) {
+						if (want_positions)
+							output._positions.push_back(packPosition(pos));
+					});
+					output._games++;
+					output._plies += game._plies;
+					output._errors += !game._error.empty();
+					if (!game._error.empty())  // only complete games go to the positions
+						output._positions.resize(first);
+					for (size_t i = first; i < output._positions.size(); i++)
+						output._positions[i]._result = game._result;
+					if (want_results) {
+						output._results += std::string(game._result == PACKED_RESULT_UNKNOWN ? "*" : PACKED_RESULT_NAMES[game._result])
+						                 + "\t" + std::to_string(game._plies) + "\t" + game._pos.fen()
+						                 + (game._error.empty() ? "" : "\t" + game._error) + "\n";
+					}
+				}
+			},
+			[&](const PgnChunkOutput& output) {
+				if (want_results) {
+					uint64_t number = total._games;
+					for (size_t line = 0; line < output._results.size(); ) {
+						size_t newline = output._results.find('\n', line);
+						results << ++number << '\t';
+						results.write(output._results.data() + line, newline + 1 - line);
+						line = newline + 1;
+					}
+				}
+				if (want_positions)
+					positions.write(reinterpret_cast<const char*>(output._positions.data()), output._positions.size() * sizeof(PackedPosition));
+				total._games += output._games;
+				total._errors += output._errors;
+				total._plies += output._plies;
+			});
+	} catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 2;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << total._games << " games, " << total._plies << " plies, " << total._errors << " with errors, "
+	          << std::fixed << std::setprecision(1) << bytes / 1e6 << " MB in " << std::setprecision(2) << seconds << " s ("
+	          << std::setprecision(1) << (seconds > 0 ? bytes / 1e6 / seconds : 0) << " MB/s, "
+	          << uint64_t(seconds > 0 ? total._games / seconds : 0) << " games/s)" << std::endl;
+	return (results_file.empty() || results) && (positions_file.empty() || positions) ? 0 : 2;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef PONDER_HPP
+#define PONDER_HPP
+
+#include "chess.hpp"
+#include <thread>
+
+/* Pondering in the interactive game: while the prompt waits for the next move,
+ * the position on the board is searched on a background thread, without any
+ * limit. As soon as a move is entered the search is aborted, the board itself
+ * was never touched, the search works on its own copy of the position.
+ *
+ * What stays behind is the transposition table of the board: the subtrees of
+ * the moves of the side to move are in it, so whichever move is entered, the
+ * next search starts from a warm table. When the engine is asked to move ("go")
+ * in the pondered position, the time spent pondering counts as thinking time,
+ * and after a long enough wait the pondered best move is played at once.
+ */
+
+struct Ponderer {
+	ChessBoard& _board;
+	thread _thread;
+	atomic<bool> _abort {false};
+	SearchResult _result;  // of the last pondering, complete after stop()
+	uint64_t _key = 0;     // of the pondered position
+	chrono::steady_clock::time_point _start;
+
+	Ponderer(ChessBoard& board) : _board(board) {}
+	~Ponderer() { stop(); }
+	void start();
+	int64_t stop();
+};
+
+void Ponderer::start() {
+	stop();
+	_abort = false;
+	_key = _board._pos._key;
+	_start = chrono::steady_clock::now();
+	SearchLimits limits;
+	limits._abort = &_abort;
+	_thread = thread([this, limits]() { _result = _board.search(limits, SearchFeatures(), false); });
+}
+
+int64_t Ponderer::stop() {
+	/* ends the pondering, returns for how many milliseconds it ran, 0 if it was
+	 * not running
+	 */
+	if (!_thread.joinable())
+		return 0;
+	_abort = true;
+	_thread.join();
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - _start).count();
+}
+
+#endif
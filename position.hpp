@@ -0,0 +1,434 @@
+#ifndef POSITION_HPP
+#define POSITION_HPP
+
+#include "bitboard.hpp"
+#include "move.hpp"
+#include "instrument.hpp"
+#include "psqt.hpp"
+#include "zobrist.hpp"
+#ifdef USE_NNUE
+#include "nnue.hpp"
+#endif
+#include <cctype>
+#include <cstring>  // memset
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+/* Everything needed to take back a move made with Position::makeMove(). Records
+ * are small and kept on a stack (the game history, or the C++ stack during a
+ * search), so a move costs a few stores instead of a copy of the board.
+ */
+struct UndoRecord {
+	Move _move;
+	Piece _captured;    // NO_PIECE if the move was not a capture
+	uint8_t _castling;  // state before the move
+	uint8_t _ep;
+	uint8_t _rule50;
+	uint64_t _key;      // position key before the move
+};
+
+/* Core position type, built on bitboards. One bitboard per piece type and color,
+ * one occupancy bitboard per color and a 64 byte mailbox, so that the piece on a
+ * square can be looked up without scanning the bitboards. Everything is stored
+ * inline, which means copying a position is a plain memcpy and never allocates.
+ */
+struct alignas(64) Position {
+	Bitboard _pieces[2][6];  // [color][piece type]
+	Bitboard _occupied[2];   // [color]
+	Piece _board[64];        // mailbox, NO_PIECE on empty squares
+	Color _side;             // side to move
+	uint8_t _castling;       // CastlingRight bits
+	uint8_t _ep;             // en passant target square, NO_SQUARE if none
+	uint8_t _rule50;         // half moves since the last capture or pawn move
+	uint16_t _game_ply;      // half moves since the start of the game
+	uint64_t _key;           // Zobrist key, updated with every change of the position
+	uint64_t _pawn_key;      // Zobrist key of the pawns alone, for the pawn hash table
+	PsqScore _psq;           // material and piece-square score of white minus black, updated like _key
+	uint8_t _phase;          // sum of the PHASE_WEIGHTS of all figures, updated like _key
+#ifdef USE_NNUE
+	mutable NnueAccumulator _acc;  // updated like _key, invalid perspectives are refreshed by evaluate()
+#endif
+
+	void clear();
+	void putPiece(Piece piece, int sq);
+	void removePiece(int sq);
+	void movePiece(int from, int to);
+	void makeMove(Move m, UndoRecord& undo);
+	void unmakeMove(const UndoRecord& undo);
+	void makeNullMove(UndoRecord& undo);
+	void unmakeNullMove(const UndoRecord& undo);
+	void inferCastlingRights();
+	void setFen(const std::string& fen);
+	std::string fen() const;
+	uint64_t computeKey() const;
+	uint64_t computePawnKey() const;
+	PsqScore computePsq() const;
+	int computePhase() const;
+
+	Piece pieceOn(int sq) const { return _board[sq]; }
+	bool isEmpty(int sq) const { return _board[sq] == NO_PIECE; }
+	Bitboard pieces(Color c, PieceType t) const { return _pieces[c][t]; }
+	Bitboard pieces(Color c) const { return _occupied[c]; }
+	Bitboard occupied() const { return _occupied[WHITE] | _occupied[BLACK]; }
+	Color sideToMove() const { return _side; }
+	bool isCapture(Move m) const { return !isEmpty(m.to()) || m.flag() == EN_PASSANT; }
+};
+
+const char START_FEN[] = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// castling rights that are kept when a piece moves from or to the square
+constexpr uint8_t castlingMask(int sq) {
+	return sq == 0  ? ALL_CASTLING & ~WHITE_OOO
+	     : sq == 4  ? ALL_CASTLING & ~WHITE_CASTLING
+	     : sq == 7  ? ALL_CASTLING & ~WHITE_OO
+	     : sq == 56 ? ALL_CASTLING & ~BLACK_OOO
+	     : sq == 60 ? ALL_CASTLING & ~BLACK_CASTLING
+	     : sq == 63 ? ALL_CASTLING & ~BLACK_OO
+	     : ALL_CASTLING;
+}
+
+// rook origin and target square of a castling move, given the king's target square
+constexpr int castlingRookFrom(int king_to) { return (king_to & 7) == 6 ? king_to + 1 : king_to - 2; }
+constexpr int castlingRookTo(int king_to) { return (king_to & 7) == 6 ? king_to - 1 : king_to + 1; }
+
+void Position::clear() {
+	/* removes all pieces from the position, white is to move
+	 */
+	memset(_pieces, 0, sizeof(_pieces));
+	memset(_occupied, 0, sizeof(_occupied));
+	memset(_board, NO_PIECE, sizeof(_board));
+	_side = WHITE;
+	_castling = 0;
+	_ep = NO_SQUARE;
+	_rule50 = 0;
+	_game_ply = 0;
+	_key = 0;
+	_pawn_key = 0;
+	_psq = PsqScore {0, 0};
+	_phase = 0;
+#ifdef USE_NNUE
+	_acc._valid[WHITE] = _acc._valid[BLACK] = false;
+#endif
+}
+
+void Position::putPiece(Piece piece, int sq) {
+	/* places a piece on an empty square
+	 */
+	Bitboard b = squareBB(sq);
+	_pieces[colorOf(piece)][typeOf(piece)] |= b;
+	_occupied[colorOf(piece)] |= b;
+	_board[sq] = piece;
+	_key ^= ZOBRIST._psq[piece][sq];
+	if (typeOf(piece) == PAWN)
+		_pawn_key ^= ZOBRIST._psq[piece][sq];
+	_psq._mg += PSQ._scores[piece][sq]._mg;
+	_psq._eg += PSQ._scores[piece][sq]._eg;
+	_phase += PHASE_WEIGHTS[typeOf(piece)];
+#ifdef USE_NNUE
+	nnueAddPiece(_acc, piece, sq);
+#endif
+}
+
+void Position::removePiece(int sq) {
+	/* removes the piece from an occupied square
+	 */
+	Piece piece = _board[sq];
+	Bitboard b = squareBB(sq);
+	_pieces[colorOf(piece)][typeOf(piece)] ^= b;
+	_occupied[colorOf(piece)] ^= b;
+	_board[sq] = NO_PIECE;
+	_key ^= ZOBRIST._psq[piece][sq];
+	if (typeOf(piece) == PAWN)
+		_pawn_key ^= ZOBRIST._psq[piece][sq];
+	_psq._mg -= PSQ._scores[piece][sq]._mg;
+	_psq._eg -= PSQ._scores[piece][sq]._eg;
+	_phase -= PHASE_WEIGHTS[typeOf(piece)];
+#ifdef USE_NNUE
+	nnueRemovePiece(_acc, piece, sq);
+#endif
+}
+
+void Position::movePiece(int from, int to) {
+	/* moves a piece to an empty square, both bitboards are updated with one xor
+	 */
+	Piece piece = _board[from];
+	Bitboard from_to = squareBB(from) | squareBB(to);
+	_pieces[colorOf(piece)][typeOf(piece)] ^= from_to;
+	_occupied[colorOf(piece)] ^= from_to;
+	_board[from] = NO_PIECE;
+	_board[to] = piece;
+	_key ^= ZOBRIST._psq[piece][from] ^ ZOBRIST._psq[piece][to];
+	if (typeOf(piece) == PAWN)
+		_pawn_key ^= ZOBRIST._psq[piece][from] ^ ZOBRIST._psq[piece][to];
+	_psq._mg += PSQ._scores[piece][to]._mg - PSQ._scores[piece][from]._mg;
+	_psq._eg += PSQ._scores[piece][to]._eg - PSQ._scores[piece][from]._eg;
+#ifdef USE_NNUE
+	nnueMovePiece(_acc, piece, from, to);
+#endif
+}
+
+void Position::makeMove(Move m, UndoRecord& undo) {
+	/* makes a (legal) move of the side to move, including castling, en passant and
+	 * promotions, and stores what is needed to take the move back in >>undo<<
+	 */
+	PROFILE_SCOPE("Position::makeMove");
+	int from = m.from(), to = m.to();
+	Piece piece = _board[from];
+	Color us = colorOf(piece);
+	int push = (us == WHITE) ? 8 : -8;
+	int capture_sq = (m.flag() == EN_PASSANT) ? to - push : to;
+
+	undo._move = m;
+	undo._captured = _board[capture_sq];
+	undo._castling = _castling;
+	undo._ep = _ep;
+	undo._rule50 = _rule50;
+	undo._key = _key;
+
+	_rule50++;
+	if (_ep != NO_SQUARE) {
+		_key ^= ZOBRIST._ep_file[colOf(_ep)];
+		_ep = NO_SQUARE;
+	}
+
+	if (m.flag() == CASTLING)
+		movePiece(castlingRookFrom(to), castlingRookTo(to));
+
+	if (undo._captured != NO_PIECE) {
+		removePiece(capture_sq);
+		_rule50 = 0;
+	}
+	movePiece(from, to);
+
+	if (typeOf(piece) == PAWN) {
+		_rule50 = 0;
+		if (m.flag() == PROMOTION) {
+			removePiece(to);
+			putPiece(makePiece(us, m.promotion()), to);
+		} else if ((from ^ to) == 16) {
+			// double push, the en passant square is only set if an enemy pawn can use it
+			int col = colOf(to);
+			Bitboard neighbours = (col > 0 ? squareBB(to - 1) : 0) | (col < 7 ? squareBB(to + 1) : 0);
+			if (neighbours & _pieces[!us][PAWN]) {
+				_ep = from + push;
+				_key ^= ZOBRIST._ep_file[colOf(_ep)];
+			}
+		}
+	}
+
+	uint8_t castling = _castling & castlingMask(from) & castlingMask(to);
+	_key ^= ZOBRIST._castling[_castling] ^ ZOBRIST._castling[castling] ^ ZOBRIST._side;
+	_castling = castling;
+	_side = !_side;
+	_game_ply++;
+}
+
+void Position::unmakeMove(const UndoRecord& undo) {
+	/* takes back the move stored in >>undo<<, must be called in reverse order of makeMove()
+	 */
+	PROFILE_SCOPE("Position::unmakeMove");
+	Move m = undo._move;
+	int from = m.from(), to = m.to();
+	_side = !_side;
+	_game_ply--;
+
+	if (m.flag() == PROMOTION) {
+		removePiece(to);
+		putPiece(makePiece(_side, PAWN), to);
+	}
+	movePiece(to, from);
+
+	if (m.flag() == CASTLING)
+		movePiece(castlingRookTo(to), castlingRookFrom(to));
+
+	if (undo._captured != NO_PIECE)
+		putPiece(undo._captured, (m.flag() == EN_PASSANT) ? to - ((_side == WHITE) ? 8 : -8) : to);
+
+	_castling = undo._castling;
+	_ep = undo._ep;
+	_rule50 = undo._rule50;
+	_key = undo._key;  // cheaper than undoing the castling and en passant parts
+}
+
+void Position::makeNullMove(UndoRecord& undo) {
+	/* passes the turn to the other side without moving (for null move pruning in
+	 * the search), must not be used while in check
+	 */
+	undo._move = MOVE_NONE;
+	undo._captured = NO_PIECE;
+	undo._castling = _castling;
+	undo._ep = _ep;
+	undo._rule50 = _rule50;
+	undo._key = _key;
+
+	if (_ep != NO_SQUARE) {
+		_key ^= ZOBRIST._ep_file[colOf(_ep)];
+		_ep = NO_SQUARE;
+	}
+	_key ^= ZOBRIST._side;
+	_rule50++;
+	_side = !_side;
+	_game_ply++;
+}
+
+void Position::unmakeNullMove(const UndoRecord& undo) {
+	_side = !_side;
+	_game_ply--;
+	_ep = undo._ep;
+	_rule50 = undo._rule50;
+	_key = undo._key;
+}
+
+void Position::inferCastlingRights() {
+	/* for boards without castling information (e.g. the text board files): a side
+	 * may castle as long as king and rook are still on their original squares
+	 */
+	_key ^= ZOBRIST._castling[_castling];
+	_castling = 0;
+	if (_board[4] == W_KING) {
+		if (_board[7] == W_ROOK) _castling |= WHITE_OO;
+		if (_board[0] == W_ROOK) _castling |= WHITE_OOO;
+	}
+	if (_board[60] == B_KING) {
+		if (_board[63] == B_ROOK) _castling |= BLACK_OO;
+		if (_board[56] == B_ROOK) _castling |= BLACK_OOO;
+	}
+	_key ^= ZOBRIST._castling[_castling];
+}
+
+void Position::setFen(const std::string& fen) {
+	/* sets up the position from a FEN string, e.g. the initial position is
+	 * "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+	 * The move counters may be left out. Throws std::invalid_argument if malformed.
+	 */
+	std::istringstream fields(fen);
+	std::string placement, side, castling = "-", ep = "-";
+	int rule50 = 0, full_moves = 1;
+	fields >> placement >> side >> castling >> ep >> rule50 >> full_moves;
+	if (placement.empty() || (side != "w" && side != "b"))
+		throw std::invalid_argument("Invalid FEN: " + fen);
+
+	clear();
+	int row = 7, col = 0;
+	for (char c : placement) {
+		if (c == '/') {
+			row--;
+			col = 0;
+		} else if (c >= '1' && c <= '8') {
+			col += c - '0';
+		} else {
+			PieceType type = (c == 'p' || c == 'P') ? PAWN : charToPieceType(char(toupper(c)));
+			if (type == NO_PIECE_TYPE || row < 0 || col > 7)
+				throw std::invalid_argument("Invalid FEN: " + fen);
+			putPiece(makePiece(isupper(c) ? WHITE : BLACK, type), makeSquare(row, col++));
+		}
+	}
+	if (popCount(pieces(WHITE, KING)) > 1 || popCount(pieces(BLACK, KING)) > 1)
+		throw std::invalid_argument("Invalid FEN, more than one king of a color: " + fen);
+
+	_side = (side == "w") ? WHITE : BLACK;
+
+	// rights are only kept, if king and rook are really on their squares
+	inferCastlingRights();
+	uint8_t rights = 0;
+	for (char c : castling) {
+		rights |= (c == 'K') ? WHITE_OO : (c == 'Q') ? WHITE_OOO : (c == 'k') ? BLACK_OO : (c == 'q') ? BLACK_OOO : 0;
+	}
+	_castling &= rights;
+
+	// like makeMove(), the en passant square is only kept if a pawn can capture there
+	if (ep.length() == 2 && ep[0] >= 'a' && ep[0] <= 'h' && ep[1] == (_side == WHITE ? '6' : '3')) {
+		int sq = makeSquare(ep[1] - '1', ep[0] - 'a');
+		Bitboard capturers = _pieces[_side][PAWN] & (ep[1] == '6' ? RANK_1_BB << 32 : RANK_1_BB << 24);
+		int col_ep = colOf(sq);
+		Bitboard neighbours = (col_ep > 0 ? FILE_A_BB << (col_ep - 1) : 0) | (col_ep < 7 ? FILE_A_BB << (col_ep + 1) : 0);
+		if (capturers & neighbours)
+			_ep = sq;
+	}
+
+	_rule50 = rule50;
+	_game_ply = 2 * (full_moves > 0 ? full_moves - 1 : 0) + (_side == BLACK);
+	_key = computeKey();
+}
+
+std::string Position::fen() const {
+	/* the position as FEN string, the inverse of setFen()
+	 */
+	std::string fen;
+	for (int row = 7; row >= 0; row--) {
+		int empty = 0;
+		for (int col = 0; col < 8; col++) {
+			Piece piece = _board[makeSquare(row, col)];
+			if (piece == NO_PIECE) {
+				empty++;
+				continue;
+			}
+			if (empty)
+				fen += char('0' + empty);
+			empty = 0;
+			char c = typeOf(piece) == PAWN ? 'P' : FIGURE_CHARS[typeOf(piece)];
+			fen += colorOf(piece) == WHITE ? c : char(tolower(c));
+		}
+		if (empty)
+			fen += char('0' + empty);
+		if (row)
+			fen += '/';
+	}
+	fen += _side == WHITE ? " w " : " b ";
+	if (_castling & WHITE_OO) fen += 'K';
+	if (_castling & WHITE_OOO) fen += 'Q';
+	if (_castling & BLACK_OO) fen += 'k';
+	if (_castling & BLACK_OOO) fen += 'q';
+	if (!_castling) fen += '-';
+	fen += _ep == NO_SQUARE ? std::string(" -") : " " + std::string(1, char('a' + colOf(_ep))) + char('1' + rowOf(_ep));
+	return fen + " " + std::to_string(_rule50) + " " + std::to_string(_game_ply / 2 + 1);
+}
+
+uint64_t Position::computeKey() const {
+	/* computes the key from scratch, _key must always be equal to it
+	 */
+	uint64_t key = ZOBRIST._castling[_castling];
+	for (int sq = 0; sq < 64; sq++) {
+		if (!isEmpty(sq))
+			key ^= ZOBRIST._psq[_board[sq]][sq];
+	}
+	if (_ep != NO_SQUARE)
+		key ^= ZOBRIST._ep_file[colOf(_ep)];
+	if (_side == BLACK)
+		key ^= ZOBRIST._side;
+	return key;
+}
+
+uint64_t Position::computePawnKey() const {
+	uint64_t key = 0;
+	for (Color c : {WHITE, BLACK}) {
+		for (Bitboard pawns = _pieces[c][PAWN]; pawns; ) {
+			int sq = popLsb(pawns);
+			key ^= ZOBRIST._psq[makePiece(c, PAWN)][sq];
+		}
+	}
+	return key;
+}
+
+PsqScore Position::computePsq() const {
+	/* computes the piece-square score from scratch, _psq must always be equal to it
+	 */
+	int mg = 0, eg = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		if (!isEmpty(sq)) {
+			mg += PSQ._scores[_board[sq]][sq]._mg;
+			eg += PSQ._scores[_board[sq]][sq]._eg;
+		}
+	}
+	return PsqScore {int16_t(mg), int16_t(eg)};
+}
+
+int Position::computePhase() const {
+	int phase = 0;
+	for (int t = KNIGHT; t < KING; t++)
+		phase += PHASE_WEIGHTS[t] * popCount(_pieces[WHITE][t] | _pieces[BLACK][t]);
+	return phase;
+}
+
+#endif
@@ -84,6 +84,7 @@ void printWelcomeScreen() {
 	string out = "";
 	out += "Welcome to ChessEngine73!\nValid figures are 'K', 'Q', 'R', 'B', 'N' or 'p'!\n";
 	out += "Moves must be specified in algebraic notation, i.e. {figure}{column}{row}. Examples are:\n";
-	out += " - Pawn from b2 to b3: 'pb2b3'\n - Queen from d1 to d5: Qd1d5";
+	out += " - Pawn from b2 to b3: 'pb2b3'\n - Queen from d1 to d5: Qd1d5\n";
+	out += " - Castling: 'Ke1g1'\n - Promotion to a knight: 'pe7e8N' (a queen, if left out)";
 	printInfoBox(out, '*');
 }
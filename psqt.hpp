@@ -0,0 +1,128 @@
+#ifndef PSQT_HPP
+#define PSQT_HPP
+
+#include "bitboard.hpp"
+
+/* Piece-square tables: the value of a piece depends on its square, e.g. knights
+ * are better in the center and the king is safer behind its pawns. There is one
+ * value for the middlegame and one for the endgame, the evaluation blends them
+ * by the material left on the board (tapered evaluation).
+ *
+ * The tables below are written as the board is printed, rank 8 on top, from the
+ * point of view of white; black uses the mirrored square. They are the
+ * "simplified evaluation function" tables of Tomasz Michniewski, with an endgame
+ * table for the pawns (advanced pawns get stronger) and the king (it belongs to
+ * the center). PSQ combines material and table for every piece and square, with
+ * white positive and black negative, so a position's score is a plain sum that
+ * Position keeps up to date while pieces are put, removed and moved.
+ */
+struct PsqScore {
+	int16_t _mg;  // middlegame
+	int16_t _eg;  // endgame
+};
+
+const int PIECE_VALUES_MG[6] = {100, 320, 330, 500, 900, 0};  // indexed by PieceType
+const int PIECE_VALUES_EG[6] = {120, 300, 320, 530, 950, 0};
+
+// game phase: the sum of the weights of all figures on the board, 24 in the initial position
+const int PHASE_WEIGHTS[6] = {0, 1, 1, 2, 4, 0};
+const int PHASE_MAX = 24;
+
+constexpr int8_t PSQT_MG[6][64] = {
+	{  // pawn
+	  0,  0,  0,  0,  0,  0,  0,  0,
+	 50, 50, 50, 50, 50, 50, 50, 50,
+	 10, 10, 20, 30, 30, 20, 10, 10,
+	  5,  5, 10, 25, 25, 10,  5,  5,
+	  0,  0,  0, 20, 20,  0,  0,  0,
+	  5, -5,-10,  0,  0,-10, -5,  5,
+	  5, 10, 10,-20,-20, 10, 10,  5,
+	  0,  0,  0,  0,  0,  0,  0,  0},
+	{  // knight
+	-50,-40,-30,-30,-30,-30,-40,-50,
+	-40,-20,  0,  0,  0,  0,-20,-40,
+	-30,  0, 10, 15, 15, 10,  0,-30,
+	-30,  5, 15, 20, 20, 15,  5,-30,
+	-30,  0, 15, 20, 20, 15,  0,-30,
+	-30,  5, 10, 15, 15, 10,  5,-30,
+	-40,-20,  0,  5,  5,  0,-20,-40,
+	-50,-40,-30,-30,-30,-30,-40,-50},
+	{  // bishop
+	-20,-10,-10,-10,-10,-10,-10,-20,
+	-10,  0,  0,  0,  0,  0,  0,-10,
+	-10,  0,  5, 10, 10,  5,  0,-10,
+	-10,  5,  5, 10, 10,  5,  5,-10,
+	-10,  0, 10, 10, 10, 10,  0,-10,
+	-10, 10, 10, 10, 10, 10, 10,-10,
+	-10,  5,  0,  0,  0,  0,  5,-10,
+	-20,-10,-10,-10,-10,-10,-10,-20},
+	{  // rook
+	  0,  0,  0,  0,  0,  0,  0,  0,
+	  5, 10, 10, 10, 10, 10, 10,  5,
+	 -5,  0,  0,  0,  0,  0,  0, -5,
+	 -5,  0,  0,  0,  0,  0,  0, -5,
+	 -5,  0,  0,  0,  0,  0,  0, -5,
+	 -5,  0,  0,  0,  0,  0,  0, -5,
+	 -5,  0,  0,  0,  0,  0,  0, -5,
+	  0,  0,  0,  5,  5,  0,  0,  0},
+	{  // queen
+	-20,-10,-10, -5, -5,-10,-10,-20,
+	-10,  0,  0,  0,  0,  0,  0,-10,
+	-10,  0,  5,  5,  5,  5,  0,-10,
+	 -5,  0,  5,  5,  5,  5,  0, -5,
+	  0,  0,  5,  5,  5,  5,  0, -5,
+	-10,  5,  5,  5,  5,  5,  0,-10,
+	-10,  0,  5,  0,  0,  0,  0,-10,
+	-20,-10,-10, -5, -5,-10,-10,-20},
+	{  // king
+	-30,-40,-40,-50,-50,-40,-40,-30,
+	-30,-40,-40,-50,-50,-40,-40,-30,
+	-30,-40,-40,-50,-50,-40,-40,-30,
+	-30,-40,-40,-50,-50,-40,-40,-30,
+	-20,-30,-30,-40,-40,-30,-30,-20,
+	-10,-20,-20,-20,-20,-20,-20,-10,
+	 20, 20,  0,  0,  0,  0, 20, 20,
+	 20, 30, 10,  0,  0, 10, 30, 20}
+};
+
+constexpr int8_t PSQT_EG_PAWN[64] = {
+	  0,  0,  0,  0,  0,  0,  0,  0,
+	 80, 80, 80, 80, 80, 80, 80, 80,
+	 50, 50, 50, 50, 50, 50, 50, 50,
+	 30, 30, 30, 30, 30, 30, 30, 30,
+	 15, 15, 15, 15, 15, 15, 15, 15,
+	  5,  5,  5,  5,  5,  5,  5,  5,
+	  0,  0,  0,  0,  0,  0,  0,  0,
+	  0,  0,  0,  0,  0,  0,  0,  0};
+
+constexpr int8_t PSQT_EG_KING[64] = {
+	-50,-40,-30,-20,-20,-30,-40,-50,
+	-30,-20,-10,  0,  0,-10,-20,-30,
+	-30,-10, 20, 30, 30, 20,-10,-30,
+	-30,-10, 30, 40, 40, 30,-10,-30,
+	-30,-10, 30, 40, 40, 30,-10,-30,
+	-30,-10, 20, 30, 30, 20,-10,-30,
+	-30,-30,  0,  0,  0,  0,-30,-30,
+	-50,-30,-30,-30,-30,-30,-30,-50};
+
+struct PsqTable {
+	PsqScore _scores[16][64];  // [piece][square], only the valid Piece values are used
+};
+
+constexpr PsqTable makePsqTable() {
+	PsqTable table {};
+	for (int t = PAWN; t <= KING; t++) {
+		for (int sq = 0; sq < 64; sq++) {
+			int index = sq ^ 56;  // the tables start with rank 8
+			int mg = PIECE_VALUES_MG[t] + PSQT_MG[t][index];
+			int eg = PIECE_VALUES_EG[t] + (t == PAWN ? PSQT_EG_PAWN[index] : t == KING ? PSQT_EG_KING[index] : PSQT_MG[t][index]);
+			table._scores[makePiece(WHITE, PieceType(t))][sq] = PsqScore {int16_t(mg), int16_t(eg)};
+			table._scores[makePiece(BLACK, PieceType(t))][sq ^ 56] = PsqScore {int16_t(-mg), int16_t(-eg)};
+		}
+	}
+	return table;
+}
+
+constexpr PsqTable PSQ = makePsqTable();
+
+#endif
@@ -0,0 +1,403 @@
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include "eval.hpp"
+#include "movepicker.hpp"
+#include "tablebase.hpp"
+#include "tt.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/* Negamax alpha-beta search with iterative deepening on the bitboard Position.
+ * The search works on its own copy of the position and makes and unmakes the
+ * moves in place. Every search enhancement can be switched off with the
+ * SearchFeatures, to measure its effect on the nodes needed for a depth.
+ *
+ * Lazy SMP: with more than one thread, every thread runs its own Searcher on the
+ * same root and they share nothing but the transposition table and the stop flag.
+ * The threads fill the table for each other, helpers with an odd id search one
+ * ply deeper, so the threads spread over different parts of the tree. The result
+ * of the main thread (id 0) is the result of the search, it also decides when to
+ * stop.
+ */
+
+const int MAX_PLY = 128;
+const int VALUE_DRAW = 0;
+const int VALUE_MATE = 32000;
+const int VALUE_INFINITE = 32001;
+const int VALUE_MATE_IN_MAX_PLY = VALUE_MATE - MAX_PLY;  // scores beyond are mates
+
+struct SearchLimits {
+	int _depth = MAX_PLY - 1;
+	int64_t _movetime_ms = 0;  // 0 means no time limit
+	int64_t _optimum_ms = 0;   // no new iteration is started after this time, 0: half the movetime
+	uint64_t _nodes = 0;       // 0 means no node limit
+	// set from another thread: _abort ends the search, while _ponder is true the
+	// time limits are not applied (they count from the start nevertheless)
+	const std::atomic<bool>* _abort = nullptr;
+	const std::atomic<bool>* _ponder = nullptr;
+};
+
+struct SearchFeatures {
+	bool _aspiration = true;  // search around the score of the last iteration first
+	bool _pvs = true;         // principal variation search: null windows after the first move
+	bool _null_move = true;   // null move pruning
+	bool _tt = true;          // transposition table cutoffs and hash move
+	bool _quiescence = true;  // captures are searched beyond the depth until the position is quiet
+	bool _history = true;     // killer moves and history scores order the quiet moves
+};
+
+struct SearchResult {
+	Move _best_move = MOVE_NONE;
+	int _score = 0;
+	int _depth = 0;        // last completed iteration
+	uint64_t _nodes = 0;
+	double _seconds = 0;
+	std::vector<Move> _pv;
+	std::vector<uint64_t> _thread_nodes;  // nodes of every search thread, _nodes is their sum
+};
+
+// mate scores are stored relative to the node in the table, relative to the root in the search
+inline int scoreToTT(int score, int ply) {
+	return score >= VALUE_MATE_IN_MAX_PLY ? score + ply : score <= -VALUE_MATE_IN_MAX_PLY ? score - ply : score;
+}
+
+inline int scoreFromTT(int score, int ply) {
+	return score >= VALUE_MATE_IN_MAX_PLY ? score - ply : score <= -VALUE_MATE_IN_MAX_PLY ? score + ply : score;
+}
+
+// moves until mate of a mate score, negative if the side to move gets mated
+inline int mateInMoves(int score) {
+	return score > 0 ? (VALUE_MATE - score + 1) / 2 : -(VALUE_MATE + score) / 2;
+}
+
+inline bool hasNonPawnMaterial(const Position& pos, Color c) {
+	return pos.pieces(c) & ~(pos.pieces(c, PAWN) | pos.pieces(c, KING));
+}
+
+struct Searcher {
+	Position _pos;
+	TranspositionTable& _tt;
+	SearchLimits _limits;
+	SearchFeatures _features;
+	std::atomic<bool>& _stop;  // set from outside (or by the limits) to end the search, shared by all threads
+	int _thread_id;            // 0 is the main thread
+	std::chrono::steady_clock::time_point _start;
+	std::atomic<uint64_t> _nodes {0};  // only written by the own thread, read by the main thread for reports
+	std::vector<uint64_t> _keys;  // keys of all earlier positions of the game and the search path
+	Move _pv[MAX_PLY + 1][MAX_PLY + 1];  // triangular PV table, row ply holds the PV from ply on
+	int _pv_length[MAX_PLY + 1];
+	Move _killers[MAX_PLY + 1][2] {};    // the last two quiet moves that caused a cutoff at a ply
+	HistoryTable _history;
+	PawnTable* _pawns = nullptr;         // of this thread, kept between searches
+	std::function<void(const SearchResult&)> _report;  // called after every completed iteration
+
+	Searcher(const Position& pos, const std::vector<uint64_t>& game_keys, TranspositionTable& tt,
+	         const SearchLimits& limits, const SearchFeatures& features, std::atomic<bool>& stop, int thread_id = 0)
+		: _pos(pos), _tt(tt), _limits(limits), _features(features), _stop(stop), _thread_id(thread_id), _keys(game_keys) {}
+
+	SearchResult run();
+	int aspirationSearch(int depth, int previous_score);
+	int negamax(int alpha, int beta, int depth, int ply, bool null_allowed);
+	int quiescence(int alpha, int beta, int ply);
+	void updateQuietStats(Move best, const Move* quiets, int quiet_count, int depth, int ply);
+	bool isRepetition() const;
+	bool checkLimits();
+	bool pondering() const { return _limits._ponder && *_limits._ponder; }
+	double elapsedSeconds() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count(); }
+};
+
+SearchResult Searcher::run() {
+	/* iterative deepening: searches depth 1, 2, ... until a limit is reached. The
+	 * result of the last completed iteration is returned, the results of earlier
+	 * iterations fill the table and make the next one cheaper.
+	 */
+	PROFILE_SCOPE("Searcher::run");
+	_start = std::chrono::steady_clock::now();
+	SearchResult result;
+	bool main_thread = _thread_id == 0;
+
+	for (int depth = 1 + (_thread_id & 1); depth <= std::min(_limits._depth, MAX_PLY - 1); depth++) {
+		int score = aspirationSearch(depth, result._score);
+		if (_stop && depth > 1)
+			break;  // the interrupted iteration is not trusted
+
+		result._depth = depth;
+		result._score = score;
+		result._pv.assign(_pv[0], _pv[0] + _pv_length[0]);
+		result._best_move = result._pv.empty() ? MOVE_NONE : result._pv[0];
+		result._nodes = _nodes;
+		result._seconds = elapsedSeconds();
+		if (_report)
+			_report(result);
+
+		if (result._pv.empty() || _stop)
+			break;  // no legal move at the root, or the first iteration hit the limit
+		// an iteration takes longer than all earlier ones, it would likely not finish
+		int64_t optimum_ms = _limits._optimum_ms ? _limits._optimum_ms : _limits._movetime_ms / 2;
+		if (main_thread && optimum_ms && !pondering() && result._seconds * 1000 > optimum_ms)
+			break;
+	}
+	if (!result._best_move) {  // stopped before the first move was searched
+		MoveList moves;
+		generateMoves<ALL>(_pos, moves);
+		if (!moves.empty())
+			result._best_move = moves[0];
+	}
+	result._nodes = _nodes;
+	result._seconds = elapsedSeconds();
+	return result;
+}
+
+int Searcher::aspirationSearch(int depth, int previous_score) {
+	/* searches with a narrow window around the score of the last iteration. The
+	 * smaller the window the more cutoffs, if the score falls outside the window
+	 * is widened and the depth searched again.
+	 */
+	if (!_features._aspiration || depth < 4 || std::abs(previous_score) >= VALUE_MATE_IN_MAX_PLY)
+		return negamax(-VALUE_INFINITE, VALUE_INFINITE, depth, 0, true);
+
+	int delta = 25;
+	int alpha = std::max(previous_score - delta, -VALUE_INFINITE);
+	int beta = std::min(previous_score + delta, VALUE_INFINITE);
+	while (true) {
+		int score = negamax(alpha, beta, depth, 0, true);
+		if (_stop)
+			return score;
+		if (score <= alpha) {
+			beta = (alpha + beta) / 2;
+			alpha = std::max(score - delta, -VALUE_INFINITE);
+		} else if (score >= beta) {
+			beta = std::min(score + delta, VALUE_INFINITE);
+		} else {
+			return score;
+		}
+		delta *= 2;
+	}
+}
+
+bool Searcher::isRepetition() const {
+	/* true if the position occurred before, since the last capture or pawn move.
+	 * Inside the search one repetition is enough to score the position as a draw.
+	 */
+	int n = _keys.size();
+	for (int i = n - 2; i >= 0 && i >= n - _pos._rule50; i -= 2) {
+		if (_keys[i] == _pos._key)
+			return true;
+	}
+	return false;
+}
+
+bool Searcher::checkLimits() {
+	if (_limits._abort && *_limits._abort)
+		_stop = true;
+	if (_limits._movetime_ms && !pondering() && elapsedSeconds() * 1000 >= _limits._movetime_ms)
+		_stop = true;
+	if (_limits._nodes && _nodes >= _limits._nodes)
+		_stop = true;
+	return _stop;
+}
+
+int Searcher::negamax(int alpha, int beta, int depth, int ply, bool null_allowed) {
+	/* returns the score of the position for the side to move, exact if it is
+	 * inside (alpha, beta), otherwise a bound (fail soft)
+	 */
+	_pv_length[ply] = 0;
+	if (depth <= 0 && _features._quiescence)
+		return quiescence(alpha, beta, ply);
+	uint64_t nodes = _nodes.load(std::memory_order_relaxed) + 1;
+	_nodes.store(nodes, std::memory_order_relaxed);  // a plain increment, only this thread writes
+	if (depth <= 0)
+		return evaluate(_pos, _pawns);
+
+	// every 256 nodes the main thread looks at the clock and the abort flag, that is
+	// well below a millisecond even with the slowest evaluation
+	if ((nodes & 255) == 0 && _thread_id == 0)
+		checkLimits();
+	if (_stop)
+		return 0;
+
+	bool root = ply == 0;
+	bool pv_node = beta - alpha > 1;
+	if (!root) {
+		if (_pos._rule50 >= 100 || isRepetition())
+			return VALUE_DRAW;
+		if (ply >= MAX_PLY)
+			return evaluate(_pos, _pawns);
+
+		// endgame tablebases: the exact result (a mate beyond MAX_PLY is no mate score,
+		// only a very high one)
+		if (popCount(_pos.occupied()) <= TABLEBASES._max_pieces) {
+			int plies = TABLEBASES.probe(_pos);
+			if (plies == TB_DRAW)
+				return VALUE_DRAW;
+			if (plies != TB_NOT_FOUND)
+				return plies % 2 ? VALUE_MATE - ply - plies : -VALUE_MATE + ply + plies;
+		}
+	}
+
+	// transposition table: a deep enough result of an earlier visit may end the search here
+	TTData tt_data;
+	Move tt_move = MOVE_NONE;
+	if (_features._tt && _tt.probe(_pos._key, tt_data)) {
+		tt_move = tt_data._move;
+		int tt_score = scoreFromTT(tt_data._score, ply);
+		if (!pv_node && tt_data._depth >= depth
+		    && ((tt_data._bound == BOUND_EXACT)
+		        || (tt_data._bound == BOUND_LOWER && tt_score >= beta)
+		        || (tt_data._bound == BOUND_UPPER && tt_score <= alpha)))
+			return tt_score;
+	}
+
+	bool in_check = inCheck(_pos);
+	int static_eval = in_check ? -VALUE_INFINITE : evaluate(_pos, _pawns);
+
+	// null move pruning: if the position is still good enough after passing the
+	// turn, a real move will be good enough as well. Not in check and not without
+	// figures, where passing would be better than every move (zugzwang).
+	if (_features._null_move && null_allowed && !pv_node && !in_check && depth >= 3
+	    && static_eval >= beta && hasNonPawnMaterial(_pos, _pos.sideToMove())) {
+		int reduction = depth >= 7 ? 3 : 2;
+		UndoRecord undo;
+		_keys.push_back(_pos._key);
+		_pos.makeNullMove(undo);
+		int score = -negamax(-beta, -beta + 1, depth - 1 - reduction, ply + 1, false);
+		_pos.unmakeNullMove(undo);
+		_keys.pop_back();
+		if (_stop)
+			return 0;
+		if (score >= beta)
+			return score >= VALUE_MATE_IN_MAX_PLY ? beta : score;  // unproven mates are not returned
+	}
+
+	int alpha_start = alpha;
+	int best_score = -VALUE_INFINITE;
+	Move best_move = MOVE_NONE;
+	int move_count = 0;
+	Move quiets[64];  // quiet moves searched without a cutoff, their history is lowered
+	int quiet_count = 0;
+	MovePicker picker(_pos, tt_move, _features._history ? _killers[ply] : nullptr,
+	                  _features._history ? &_history : nullptr);
+	UndoRecord undo;
+
+	for (Move m = picker.next(); m; m = picker.next()) {
+		move_count++;
+		bool quiet = !_pos.isCapture(m) && m.flag() != PROMOTION;
+		_keys.push_back(_pos._key);
+		_pos.makeMove(m, undo);
+
+		int score;
+		if (move_count == 1 || !_features._pvs) {
+			score = -negamax(-beta, -alpha, depth - 1, ply + 1, true);
+		} else {
+			// the first move is expected to be the best, the others only have to be
+			// shown worse, which a null window does cheaply. Searched again if not.
+			score = -negamax(-alpha - 1, -alpha, depth - 1, ply + 1, true);
+			if (score > alpha && score < beta)
+				score = -negamax(-beta, -alpha, depth - 1, ply + 1, true);
+		}
+
+		_pos.unmakeMove(undo);
+		_keys.pop_back();
+		if (_stop)
+			return 0;
+
+		if (score > best_score) {
+			best_score = score;
+			best_move = m;
+			if (score > alpha) {
+				alpha = score;
+				_pv[ply][0] = m;
+				std::copy(_pv[ply + 1], _pv[ply + 1] + _pv_length[ply + 1], _pv[ply] + 1);
+				_pv_length[ply] = _pv_length[ply + 1] + 1;
+				if (alpha >= beta) {
+					if (quiet && _features._history)
+						updateQuietStats(m, quiets, quiet_count, depth, ply);
+					break;  // the opponent will not allow this line
+				}
+			}
+		}
+		if (quiet && quiet_count < 64)
+			quiets[quiet_count++] = m;
+	}
+
+	if (move_count == 0)
+		return in_check ? -VALUE_MATE + ply : VALUE_DRAW;
+
+	if (_features._tt) {
+		Bound bound = best_score >= beta ? BOUND_LOWER : best_score > alpha_start ? BOUND_EXACT : BOUND_UPPER;
+		_tt.store(_pos._key, best_move, scoreToTT(best_score, ply), static_eval, depth, bound);
+	}
+	return best_score;
+}
+
+int Searcher::quiescence(int alpha, int beta, int ply) {
+	/* searches only captures (and promotions) until the position is quiet, so the
+	 * evaluation is never taken in the middle of an exchange. The side to move may
+	 * stand pat, i.e. take the static evaluation instead of capturing. Captures that
+	 * lose material by static exchange evaluation are not searched at all. In check
+	 * all evasions are searched, otherwise a mate would be missed.
+	 */
+	uint64_t nodes = _nodes.load(std::memory_order_relaxed) + 1;
+	_nodes.store(nodes, std::memory_order_relaxed);
+	if ((nodes & 255) == 0 && _thread_id == 0)
+		checkLimits();
+	if (_stop)
+		return 0;
+	if (ply >= MAX_PLY)
+		return evaluate(_pos, _pawns);
+
+	bool in_check = inCheck(_pos);
+	int best_score = -VALUE_INFINITE;
+	if (!in_check) {
+		best_score = evaluate(_pos, _pawns);
+		if (best_score >= beta)
+			return best_score;
+		alpha = std::max(alpha, best_score);
+	}
+
+	MovePicker picker = in_check ? MovePicker(_pos) : MovePicker(_pos, true);
+	UndoRecord undo;
+	int move_count = 0;
+	for (Move m = picker.next(); m; m = picker.next()) {
+		move_count++;
+		_pos.makeMove(m, undo);
+		int score = -quiescence(-beta, -alpha, ply + 1);
+		_pos.unmakeMove(undo);
+		if (_stop)
+			return 0;
+
+		if (score > best_score) {
+			best_score = score;
+			if (score > alpha) {
+				alpha = score;
+				if (alpha >= beta)
+					break;
+			}
+		}
+	}
+
+	if (in_check && move_count == 0)
+		return -VALUE_MATE + ply;
+	return best_score;
+}
+
+void Searcher::updateQuietStats(Move best, const Move* quiets, int quiet_count, int depth, int ply) {
+	/* the quiet move >>best<< caused a cutoff: it becomes a killer of the ply and its
+	 * history score rises, the quiet moves searched before it were worse and fall
+	 */
+	if (_killers[ply][0] != best) {
+		_killers[ply][1] = _killers[ply][0];
+		_killers[ply][0] = best;
+	}
+	Color us = _pos.sideToMove();
+	int bonus = std::min(depth * depth, 400);
+	_history.update(us, best, bonus);
+	for (int i = 0; i < quiet_count; i++)
+		_history.update(us, quiets[i], -bonus);
+}
+
+#endif
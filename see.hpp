@@ -0,0 +1,86 @@
+#ifndef SEE_HPP
+#define SEE_HPP
+
+#include "eval.hpp"
+#include "movegen.hpp"
+
+/* Static exchange evaluation: the material a move wins or loses if both sides
+ * keep capturing on its target square, always with their least valuable figure,
+ * and every side may stop capturing when that is better for it. All attackers of
+ * the square take part, including the ones hidden behind other sliders (x-rays),
+ * which are added as soon as the figure in front of them has captured. Pins are
+ * ignored, so the result is an estimate and no search.
+ */
+
+inline int captureValue(const Position& pos, Move m) {
+	/* material gained by the move itself, before any recapture
+	 */
+	int value = m.flag() == EN_PASSANT ? PIECE_VALUES[PAWN]
+	          : pos.isEmpty(m.to()) ? 0 : PIECE_VALUES[typeOf(pos.pieceOn(m.to()))];
+	if (m.flag() == PROMOTION)
+		value += PIECE_VALUES[m.promotion()] - PIECE_VALUES[PAWN];
+	return value;
+}
+
+int see(const Position& pos, Move m) {
+	/* returns the material balance of the exchange started by >>m<< for the side
+	 * to move, e.g. 0 for PxP defended by a pawn, -200 for QxR defended by a pawn
+	 */
+	if (m.flag() == CASTLING)
+		return 0;
+
+	int from = m.from(), to = m.to();
+	Color side = pos.sideToMove();
+	Bitboard occupied = pos.occupied() ^ squareBB(from);
+	if (m.flag() == EN_PASSANT)
+		occupied ^= squareBB(to + (side == WHITE ? -8 : 8));
+
+	Bitboard bishops_queens = pos.pieces(WHITE, BISHOP) | pos.pieces(BLACK, BISHOP)
+	                        | pos.pieces(WHITE, QUEEN) | pos.pieces(BLACK, QUEEN);
+	Bitboard rooks_queens = pos.pieces(WHITE, ROOK) | pos.pieces(BLACK, ROOK)
+	                      | pos.pieces(WHITE, QUEEN) | pos.pieces(BLACK, QUEEN);
+	Bitboard attackers = attackersTo(pos, to, occupied) & occupied;
+
+	// gain[d] is the balance for the side that made capture d, if the exchange stops after it
+	int gain[32];
+	int d = 0;
+	gain[0] = captureValue(pos, m);
+	int on_square = m.flag() == PROMOTION ? PIECE_VALUES[m.promotion()] : PIECE_VALUES[typeOf(pos.pieceOn(from))];
+
+	while (true) {
+		side = !side;
+		Bitboard own = attackers & pos.pieces(side);
+		if (!own)
+			break;
+
+		int type = PAWN;
+		while (!(own & pos.pieces(side, PieceType(type))))
+			type++;
+		if (type == KING && (attackers & pos.pieces(!side)))
+			break;  // the king cannot capture a defended figure
+
+		d++;
+		gain[d] = on_square - gain[d - 1];
+		if (std::max(-gain[d - 1], gain[d]) < 0) {
+			d--;  // the capture would not be made, and no later one changes the outcome
+			break;
+		}
+
+		occupied ^= squareBB(lsb(own & pos.pieces(side, PieceType(type))));
+		if (type == PAWN || type == BISHOP || type == QUEEN)
+			attackers |= bishopAttacks(to, occupied) & bishops_queens;
+		if (type == ROOK || type == QUEEN)
+			attackers |= rookAttacks(to, occupied) & rooks_queens;
+		attackers &= occupied;
+		on_square = PIECE_VALUES[type];
+	}
+
+	// going back from the last capture, every side only captures if that is better than stopping
+	while (d > 0) {
+		gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+		d--;
+	}
+	return gain[0];
+}
+
+#endif
@@ -0,0 +1,683 @@
+#ifndef TABLEBASE_HPP
+#define TABLEBASE_HPP
+
+#include "movegen.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/* Endgame tablebases for the pawnless material sets of 3 and 4 pieces, e.g. KQvK,
+ * KRvK or KQvKR: for every position the distance to mate, in plies, of perfect
+ * play (the 50 move rule is ignored), or that it is a draw.
+ *
+ * Generation ("main tbgen", see tablebaseMain()) is a retrograde analysis. The
+ * checkmates are found first, then pass d resolves the positions mated or mating
+ * in exactly d plies: a position wins if a move leads to a position lost in less
+ * than d plies, it is lost if all its moves lead to positions won in less than d
+ * plies. Only the predecessors of the positions resolved in pass d - 1 (found by
+ * taking moves back) can change, plus the positions whose captures lead into a
+ * smaller table at exactly that distance, so a pass looks at few positions. The
+ * positions still open when nothing changes any more are draws. Each pass is
+ * split into index ranges that the threads evaluate in parallel; the results are
+ * written after the pass, so the threads only ever read the table.
+ *
+ * Index: the first (white) king is brought into the a1-d1-d4 triangle by mirroring
+ * the board (10 squares instead of 64), every other piece has 64 squares, and the
+ * side to move is the lowest bit. Indices that decode to an illegal position, or
+ * to one that has another index (mirrored at the diagonal, or twin figures in the
+ * other order), are drawn.
+ * Positions with the colors swapped, e.g. KvKQ, are looked up in the table of
+ * the mirrored position.
+ *
+ * File (little endian): a 64 byte header (magic, material, bits per entry, longest
+ * mate, positions), then one code per index packed into the bits per entry: 0 is
+ * a draw (or an illegal index), n > 0 means mate after n - 1 plies, odd plies are
+ * wins of the side to move. The files are mapped into memory, a probe is one
+ * index computation and one read.
+ */
+
+const int TB_MAX_PIECES = 4;
+const int TB_NOT_FOUND = -2;  // results of Tablebases::probe(), otherwise the plies to mate
+const int TB_DRAW = -1;
+
+// states of a position during the generation, all smaller values are plies to mate
+const uint16_t TB_GEN_UNKNOWN = 0xFFFF;
+const uint16_t TB_GEN_ILLEGAL = 0xFFFE;
+const uint16_t TB_GEN_DRAW = 0xFFFD;
+
+const char TB_MAGIC[8] = {'C', '7', '3', 'T', 'B', '0', '0', '1'};
+const char TB_FIGURES[] = "QRBN";  // the order of the figures in a material name
+
+// the squares of the first king, the a1-d1-d4 triangle
+const int TB_KING_SQUARES[10] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+
+struct TbHeader {
+	char _magic[8];
+	char _name[8];        // material, e.g. "KQvKR", NUL terminated
+	uint32_t _bits;       // per entry
+	uint32_t _max_plies;  // longest mate
+	uint64_t _positions;
+	char _padding[32];
+};
+static_assert(sizeof(TbHeader) == 64, "the header is one cache line");
+
+struct TbMaterial {
+	std::string _name;
+	int _count = 0;
+	Piece _pieces[TB_MAX_PIECES];  // white king, white figures, black king, black figures
+	uint32_t _signature = 0;
+	uint64_t _positions = 0;  // size of the index
+};
+
+inline uint32_t tbSideSignature(int queens, int rooks, int bishops, int knights) {
+	return queens | rooks << 4 | bishops << 8 | knights << 12;
+}
+
+inline uint32_t tbSignature(const Position& pos, Color first) {
+	/* material of >>pos<< as it would be in the table with >>first<< as the white side
+	 */
+	uint32_t sides[2];
+	for (Color c : {first, Color(!first)}) {
+		sides[c != first] = tbSideSignature(popCount(pos.pieces(c, QUEEN)), popCount(pos.pieces(c, ROOK)),
+		                                    popCount(pos.pieces(c, BISHOP)), popCount(pos.pieces(c, KNIGHT)));
+	}
+	return sides[0] | sides[1] << 16;
+}
+
+std::string tbCanonicalName(std::string white, std::string black) {
+	/* the name of the table that holds a material: the figures of both sides in
+	 * the order QRBN, and the stronger side (more figures, then higher ones) first
+	 */
+	auto order = [](char a, char b) { return strchr(TB_FIGURES, a) < strchr(TB_FIGURES, b); };
+	std::sort(white.begin(), white.end(), order);
+	std::sort(black.begin(), black.end(), order);
+	bool swap = black.size() > white.size()
+	         || (black.size() == white.size() && std::lexicographical_compare(white.begin(), white.end(), black.begin(), black.end(),
+	                                                                          [&](char a, char b) { return order(b, a); }));
+	return swap ? "K" + black + "vK" + white : "K" + white + "vK" + black;
+}
+
+TbMaterial tbMaterial(const std::string& name) {
+	/* parses a material name like "KQvKR", throws std::runtime_error if it is not
+	 * a pawnless set of 3 or 4 pieces
+	 */
+	size_t v = name.find('v');
+	if (v == std::string::npos || name[0] != 'K' || v + 1 >= name.size() || name[v + 1] != 'K')
+		throw std::runtime_error("Material " + name + " is not written like KQvKR");
+	std::string sides[2] = {name.substr(1, v - 1), name.substr(v + 2)};
+	TbMaterial material;
+	material._name = tbCanonicalName(sides[0], sides[1]);
+	if (material._name != name)
+		throw std::runtime_error("Material " + name + " is written " + material._name);
+
+	uint32_t counts[2][4] = {};
+	for (Color c : {WHITE, BLACK}) {
+		material._pieces[material._count++] = makePiece(c, KING);
+		for (char figure : sides[c]) {
+			const char* type = strchr(FIGURE_CHARS, figure);
+			if (!type || figure == 'p' || figure == 'K')
+				throw std::runtime_error("Material " + name + " has a pawn or an unknown figure, only Q, R, B and N are supported");
+			if (material._count == TB_MAX_PIECES)
+				throw std::runtime_error("Material " + name + " has more than 4 pieces");
+			material._pieces[material._count++] = makePiece(c, PieceType(type - FIGURE_CHARS));
+			counts[c][strchr(TB_FIGURES, figure) - TB_FIGURES]++;
+		}
+	}
+	if (material._count < 3)
+		throw std::runtime_error("Material " + name + " has only the kings");
+	material._signature = tbSideSignature(counts[0][0], counts[0][1], counts[0][2], counts[0][3])
+	                    | tbSideSignature(counts[1][0], counts[1][1], counts[1][2], counts[1][3]) << 16;
+	material._positions = 10 * 2;
+	for (int i = 1; i < material._count; i++)
+		material._positions *= 64;
+	return material;
+}
+
+inline int tbTransform(int sq, int symmetry) {
+	/* mirrors a square, bit 0 of >>symmetry<< flips the files, bit 1 the ranks and
+	 * bit 2 the a1-h8 diagonal (in this order)
+	 */
+	int row = rowOf(sq), col = colOf(sq);
+	if (symmetry & 1) col = 7 - col;
+	if (symmetry & 2) row = 7 - row;
+	return symmetry & 4 ? 8 * col + row : 8 * row + col;
+}
+
+inline int tbSymmetry(int king) {
+	/* the mirroring that brings the first king into the a1-d1-d4 triangle
+	 */
+	int symmetry = 0, row = rowOf(king), col = colOf(king);
+	if (col > 3) { symmetry |= 1; col = 7 - col; }
+	if (row > 3) { symmetry |= 2; row = 7 - row; }
+	if (row > col) symmetry |= 4;
+	return symmetry;
+}
+
+inline int tbKingIndex(int sq) {
+	return int(std::find(TB_KING_SQUARES, TB_KING_SQUARES + 10, sq) - TB_KING_SQUARES);
+}
+
+inline uint64_t tbSquaresIndex(const TbMaterial& material, const int* squares, int symmetry) {
+	int mirrored[TB_MAX_PIECES];
+	for (int i = 0; i < material._count; i++)
+		mirrored[i] = tbTransform(squares[i], symmetry);
+	// two figures of one kind (KRRvK) are ordered by square, so a position has one index
+	for (int i = 2; i < material._count; i++) {
+		if (material._pieces[i] == material._pieces[i - 1] && mirrored[i] < mirrored[i - 1])
+			std::swap(mirrored[i], mirrored[i - 1]);
+	}
+	uint64_t index = tbKingIndex(mirrored[0]);
+	for (int i = 1; i < material._count; i++)
+		index = index * 64 + mirrored[i];
+	return index;
+}
+
+uint64_t tbIndex(const TbMaterial& material, const Position& pos, bool flip) {
+	/* index of >>pos<<, with the colors swapped (and the board mirrored) if >>flip<<
+	 */
+	int squares[TB_MAX_PIECES];
+	Bitboard taken = 0;
+	for (int i = 0; i < material._count; i++) {
+		Piece piece = material._pieces[i];
+		int sq = lsb(pos.pieces(Color(colorOf(piece) ^ flip), typeOf(piece)) & ~taken);
+		taken |= squareBB(sq);
+		squares[i] = flip ? sq ^ 56 : sq;
+	}
+	int symmetry = tbSymmetry(squares[0]);
+	uint64_t index = tbSquaresIndex(material, squares, symmetry);
+	// a king on the a1-d4 diagonal stays in the triangle if the board is mirrored at
+	// the diagonal, of the two indices of the position the smaller one is taken
+	int king = tbTransform(squares[0], symmetry);
+	if (rowOf(king) == colOf(king))
+		index = std::min(index, tbSquaresIndex(material, squares, symmetry ^ 4));
+	return index * 2 + (pos.sideToMove() ^ flip);
+}
+
+bool tbPosition(const TbMaterial& material, uint64_t index, Position& pos) {
+	/* sets up the position of an index, false if it is not a legal position (two
+	 * pieces on a square, or the side that is not to move in check)
+	 */
+	Color us = Color(index & 1);
+	index >>= 1;
+	int squares[TB_MAX_PIECES];
+	for (int i = material._count - 1; i > 0; i--) {
+		squares[i] = index % 64;
+		index /= 64;
+	}
+	squares[0] = TB_KING_SQUARES[index];
+
+	pos.clear();
+	for (int i = 0; i < material._count; i++) {
+		if (!pos.isEmpty(squares[i]))
+			return false;
+		pos.putPiece(material._pieces[i], squares[i]);
+	}
+	pos._side = us;
+	return !(attackersTo(pos, lsb(pos.pieces(!us, KING)), pos.occupied()) & pos.pieces(us));
+}
+
+inline uint32_t tbReadCode(const unsigned char* data, uint32_t bits, uint64_t index) {
+	/* reads 8 bytes, the file has 8 bytes of padding at the end
+	 */
+	uint64_t bit = index * bits, word;
+	memcpy(&word, data + bit / 8, 8);
+	return uint32_t(word >> (bit % 8)) & ((1u << bits) - 1);
+}
+
+struct Tablebase {
+	TbMaterial _material;
+	void* _mapping = nullptr;
+	size_t _size = 0;
+	const unsigned char* _data = nullptr;
+	uint32_t _bits = 0;
+	uint32_t _max_plies = 0;
+
+	~Tablebase() { if (_mapping) munmap(_mapping, _size); }
+	void load(const std::string& filename);
+	int probe(const Position& pos, bool flip) const {
+		uint32_t code = tbReadCode(_data, _bits, tbIndex(_material, pos, flip));
+		return code ? int(code) - 1 : TB_DRAW;
+	}
+};
+
+void Tablebase::load(const std::string& filename) {
+	/* maps a table into memory, throws std::runtime_error if it cannot be read
+	 */
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open tablebase " + filename);
+	struct stat info;
+	if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(TbHeader)) {
+		close(fd);
+		throw std::runtime_error("Tablebase " + filename + " is too short");
+	}
+	void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);  // the mapping stays valid
+	if (mapping == MAP_FAILED)
+		throw std::runtime_error("Cannot map tablebase " + filename);
+
+	TbHeader header;
+	memcpy(&header, mapping, sizeof(header));
+	header._name[7] = '\0';
+	try {
+		if (memcmp(header._magic, TB_MAGIC, 8) != 0 || header._bits == 0 || header._bits > 16)
+			throw std::runtime_error("Tablebase " + filename + " has a different format");
+		_material = tbMaterial(header._name);
+		if (header._positions != _material._positions
+		    || size_t(info.st_size) != sizeof(TbHeader) + (header._positions * header._bits + 7) / 8 + 8)
+			throw std::runtime_error("Tablebase " + filename + " has not the size of its material");
+	} catch (const std::exception&) {
+		munmap(mapping, info.st_size);
+		throw;
+	}
+	madvise(mapping, info.st_size, MADV_RANDOM);
+	_mapping = mapping;
+	_size = info.st_size;
+	_data = static_cast<const unsigned char*>(mapping) + sizeof(TbHeader);
+	_bits = header._bits;
+	_max_plies = header._max_plies;
+}
+
+struct Tablebases {
+	std::vector<std::unique_ptr<Tablebase>> _tables;
+	int _max_pieces = 0;  // 0 while no table is loaded, probes are skipped then
+
+	void load(const std::string& filename);
+	int loadDirectory(const std::string& directory, std::vector<std::string>& errors);
+	const Tablebase* find(const std::string& name) const;
+	int probe(const Position& pos) const;
+};
+
+Tablebases TABLEBASES;
+
+void Tablebases::load(const std::string& filename) {
+	auto table = std::make_unique<Tablebase>();
+	table->load(filename);
+	for (auto& loaded : _tables) {
+		if (loaded->_material._signature == table->_material._signature) {
+			loaded = std::move(table);  // a newer file of the same material
+			return;
+		}
+	}
+	_max_pieces = std::max(_max_pieces, table->_material._count);
+	_tables.push_back(std::move(table));
+}
+
+int Tablebases::loadDirectory(const std::string& directory, std::vector<std::string>& errors) {
+	/* loads all tables (*.c73tb) of a directory, returns how many. A table that
+	 * cannot be read is skipped, its error appended to >>errors<<, the others are
+	 * still loaded. Throws std::runtime_error if the directory cannot be read.
+	 */
+	DIR* dir = opendir(directory.c_str());
+	if (!dir)
+		throw std::runtime_error("Cannot open tablebase directory " + directory);
+	std::vector<std::string> files;
+	while (dirent* entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if (name.size() > 6 && name.substr(name.size() - 6) == ".c73tb")
+			files.push_back(directory + "/" + name);
+	}
+	closedir(dir);
+	int count = 0;
+	for (const std::string& file : files) {
+		try {
+			load(file);
+			count++;
+		} catch (const std::exception& e) {
+			errors.push_back(e.what());
+		}
+	}
+	return count;
+}
+
+const Tablebase* Tablebases::find(const std::string& name) const {
+	for (auto& table : _tables) {
+		if (table->_material._name == name)
+			return table.get();
+	}
+	return nullptr;
+}
+
+int Tablebases::probe(const Position& pos) const {
+	/* the plies to mate of the position (odd: the side to move mates, even: it is
+	 * mated), TB_DRAW, or TB_NOT_FOUND if no table has the position. Positions with
+	 * castling rights are not in the tables.
+	 */
+	int count = popCount(pos.occupied());
+	if (count > _max_pieces || pos._castling || pos.pieces(WHITE, PAWN) || pos.pieces(BLACK, PAWN))
+		return TB_NOT_FOUND;
+	if (count == 2)
+		return TB_DRAW;
+	uint32_t white_first = tbSignature(pos, WHITE), black_first = tbSignature(pos, BLACK);
+	for (auto& table : _tables) {
+		if (table->_material._signature == white_first)
+			return table->probe(pos, false);
+		if (table->_material._signature == black_first)
+			return table->probe(pos, true);
+	}
+	return TB_NOT_FOUND;
+}
+
+inline Bitboard tbAttacks(PieceType type, int sq, Bitboard occupied) {
+	switch (type) {
+		case KNIGHT: return knightAttacks(sq);
+		case BISHOP: return bishopAttacks(sq, occupied);
+		case ROOK:   return rookAttacks(sq, occupied);
+		case QUEEN:  return queenAttacks(sq, occupied);
+		default:     return kingAttacks(sq);
+	}
+}
+
+struct TbGenerator {
+	const TbMaterial& _material;
+	std::vector<uint16_t> _plies;       // TB_GEN_* states or plies to mate, by index
+	std::vector<uint8_t> _candidates;   // positions to evaluate in the current pass
+	std::vector<std::vector<uint64_t>> _seeds;  // [pass] positions whose captures decide in that pass
+	WorkStealingPool<std::pair<uint64_t, uint64_t>> _pool;  // index ranges
+	std::vector<std::vector<uint64_t>> _results;  // [worker] positions resolved in the current pass
+	int _passes = 0;
+
+	TbGenerator(const TbMaterial& material, int threads)
+		: _material(material), _plies(material._positions, TB_GEN_UNKNOWN),
+		  _candidates(material._positions, 0), _pool(threads), _results(threads) {}
+	void generate();
+	uint16_t successor(const Position& pos) const;
+	void initialize(uint64_t index, std::vector<std::pair<int, uint64_t>>& seeds);
+	bool resolves(uint64_t index, int pass) const;
+	void markPredecessors(uint64_t index);
+	template<typename Run> void parallelRanges(Run run);
+};
+
+template<typename Run>
+void TbGenerator::parallelRanges(Run run) {
+	/* calls run(worker, begin, end) for ranges of all indices
+	 */
+	const uint64_t range = 1 << 16;
+	for (uint64_t begin = 0, i = 0; begin < _material._positions; begin += range, i++)
+		_pool.push(int(i), {begin, std::min(begin + range, _material._positions)});
+	_pool.run([&](int worker, const std::pair<uint64_t, uint64_t>& r) { run(worker, r.first, r.second); });
+}
+
+uint16_t TbGenerator::successor(const Position& pos) const {
+	/* state of the position after a move: in this table, or after a capture in a
+	 * smaller one, which must be loaded already
+	 */
+	int count = popCount(pos.occupied());
+	if (count == _material._count)
+		return _plies[tbIndex(_material, pos, false)];
+	if (count == 2)
+		return TB_GEN_DRAW;
+	int plies = TABLEBASES.probe(pos);
+	if (plies == TB_NOT_FOUND)
+		throw std::runtime_error("A table needed for the captures of " + _material._name + " is missing");
+	return plies == TB_DRAW ? TB_GEN_DRAW : uint16_t(plies);
+}
+
+void TbGenerator::initialize(uint64_t index, std::vector<std::pair<int, uint64_t>>& seeds) {
+	/* finds the illegal positions, checkmates and stalemates, and the passes in
+	 * which the captures of a position may decide it
+	 */
+	Position pos;
+	if (!tbPosition(_material, index, pos) || tbIndex(_material, pos, false) != index) {
+		_plies[index] = TB_GEN_ILLEGAL;  // illegal, or the same position as another index
+		return;
+	}
+	MoveList moves;
+	generateMoves(pos, moves);
+	if (moves.empty()) {
+		_plies[index] = inCheck(pos) ? 0 : TB_GEN_DRAW;
+		return;
+	}
+	int shortest_loss = -1, longest_win = -1;
+	bool drawing_capture = false;
+	for (Move m : moves) {
+		if (!pos.isCapture(m))
+			continue;
+		UndoRecord undo;
+		pos.makeMove(m, undo);
+		uint16_t plies = successor(pos);
+		pos.unmakeMove(undo);
+		if (plies == TB_GEN_DRAW)
+			drawing_capture = true;
+		else if (plies % 2 == 0)
+			shortest_loss = shortest_loss < 0 ? plies : std::min<int>(shortest_loss, plies);
+		else
+			longest_win = std::max<int>(longest_win, plies);
+	}
+	if (shortest_loss >= 0)
+		seeds.push_back({shortest_loss + 1, index});
+	if (longest_win >= 0 && !drawing_capture)
+		seeds.push_back({longest_win + 1, index});
+}
+
+bool TbGenerator::resolves(uint64_t index, int pass) const {
+	/* true if the open position at >>index<< is won or lost in >>pass<< plies, i.e.
+	 * with the positions resolved in the earlier passes
+	 */
+	Position pos;
+	tbPosition(_material, index, pos);
+	MoveList moves;
+	generateMoves(pos, moves);
+	bool all_won = true;  // all moves lead to positions won by the opponent
+	for (Move m : moves) {
+		UndoRecord undo;
+		pos.makeMove(m, undo);
+		uint16_t plies = successor(pos);
+		pos.unmakeMove(undo);
+		if (plies >= pass) {  // open, a draw, or decided later
+			all_won = false;
+			continue;
+		}
+		if (plies % 2 == 0)
+			return true;  // the opponent gets mated
+	}
+	return all_won;
+}
+
+void TbGenerator::markPredecessors(uint64_t index) {
+	/* marks the positions with a move to the position at >>index<<: a figure of the
+	 * side that is not to move is taken back to one of the empty squares it attacks
+	 */
+	Position pos;
+	tbPosition(_material, index, pos);
+	Color them = !pos.sideToMove();
+	Bitboard occupied = pos.occupied();
+	for (Bitboard figures = pos.pieces(them); figures; ) {
+		int from = popLsb(figures);
+		for (Bitboard origins = tbAttacks(typeOf(pos.pieceOn(from)), from, occupied) & ~occupied; origins; ) {
+			int origin = popLsb(origins);
+			pos.movePiece(from, origin);
+			pos._side = them;
+			_candidates[tbIndex(_material, pos, false)] = 1;
+			pos._side = !them;
+			pos.movePiece(origin, from);
+		}
+	}
+}
+
+void TbGenerator::generate() {
+	std::vector<std::vector<std::pair<int, uint64_t>>> seeds(_results.size());
+	parallelRanges([&](int worker, uint64_t begin, uint64_t end) {
+		for (uint64_t index = begin; index < end; index++)
+			initialize(index, seeds[worker]);
+	});
+	for (auto& worker_seeds : seeds) {
+		for (auto& seed : worker_seeds) {
+			if (int(_seeds.size()) <= seed.first)
+				_seeds.resize(seed.first + 1);
+			_seeds[seed.first].push_back(seed.second);
+		}
+	}
+
+	std::vector<uint64_t> resolved;  // in the last pass
+	for (uint64_t index = 0; index < _material._positions; index++) {
+		if (_plies[index] == 0)
+			resolved.push_back(index);
+	}
+	for (int pass = 1; !resolved.empty() || pass < int(_seeds.size()); pass++) {
+		for (uint64_t index : resolved)
+			markPredecessors(index);
+		if (pass < int(_seeds.size())) {
+			for (uint64_t index : _seeds[pass])
+				_candidates[index] = 1;
+			std::vector<uint64_t>().swap(_seeds[pass]);
+		}
+
+		parallelRanges([&](int worker, uint64_t begin, uint64_t end) {
+			for (uint64_t index = begin; index < end; index++) {
+				if (!_candidates[index])
+					continue;
+				_candidates[index] = 0;
+				if (_plies[index] == TB_GEN_UNKNOWN && resolves(index, pass))
+					_results[worker].push_back(index);
+			}
+		});
+		resolved.clear();
+		for (auto& results : _results) {
+			for (uint64_t index : results)
+				_plies[index] = pass;
+			resolved.insert(resolved.end(), results.begin(), results.end());
+			results.clear();
+		}
+		if (!resolved.empty())
+			_passes = pass;
+	}
+	for (uint16_t& plies : _plies) {
+		if (plies == TB_GEN_UNKNOWN)
+			plies = TB_GEN_DRAW;
+	}
+}
+
+void writeTablebase(const std::string& filename, const TbMaterial& material, const std::vector<uint16_t>& plies) {
+	uint32_t max_plies = 0;
+	for (uint16_t p : plies) {
+		if (p < TB_GEN_DRAW)
+			max_plies = std::max<uint32_t>(max_plies, p);
+	}
+	uint32_t bits = 1;
+	while ((1u << bits) <= max_plies + 1)
+		bits++;
+
+	std::string data((material._positions * bits + 7) / 8 + 8, '\0');  // 8 bytes padding for tbReadCode()
+	for (uint64_t index = 0; index < material._positions; index++) {
+		uint64_t code = plies[index] < TB_GEN_DRAW ? plies[index] + 1 : 0;
+		uint64_t bit = index * bits, word;
+		memcpy(&word, &data[bit / 8], 8);
+		word |= code << (bit % 8);
+		memcpy(&data[bit / 8], &word, 8);
+	}
+
+	TbHeader header {};
+	memcpy(header._magic, TB_MAGIC, 8);
+	strncpy(header._name, material._name.c_str(), sizeof(header._name) - 1);
+	header._bits = bits;
+	header._max_plies = max_plies;
+	header._positions = material._positions;
+	std::ofstream file(filename, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(data.data(), data.size());
+	if (!file)
+		throw std::runtime_error("Cannot write tablebase " + filename);
+}
+
+void generateTablebase(const std::string& directory, const std::string& name, int threads) {
+	/* generates the table of >>name<< into the directory, and the tables of its
+	 * captures first. Tables that are loaded or in the directory are not generated
+	 * again.
+	 */
+	if (TABLEBASES.find(name))
+		return;
+	std::string filename = directory + "/" + name + ".c73tb";
+	if (access(filename.c_str(), R_OK) == 0) {
+		TABLEBASES.load(filename);
+		return;
+	}
+	TbMaterial material = tbMaterial(name);
+	size_t v = name.find('v');
+	std::string sides[2] = {name.substr(1, v - 1), name.substr(v + 2)};
+	for (int side = 0; side < 2; side++) {
+		for (size_t i = 0; i < sides[side].size(); i++) {
+			std::string rest = sides[side];
+			rest.erase(i, 1);
+			if (rest.size() + sides[!side].size() > 0)
+				generateTablebase(directory, side ? tbCanonicalName(sides[0], rest) : tbCanonicalName(rest, sides[1]), threads);
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	TbGenerator generator(material, threads);
+	generator.generate();
+	writeTablebase(filename, material, generator._plies);
+	TABLEBASES.load(filename);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t wins = 0, losses = 0, draws = 0;
+	for (uint16_t plies : generator._plies) {
+		if (plies == TB_GEN_DRAW) draws++;
+		else if (plies < TB_GEN_DRAW) (plies % 2 ? wins : losses)++;
+	}
+	const Tablebase* table = TABLEBASES.find(name);
+	std::cout << name << ": " << material._positions << " positions, " << wins << " won, " << draws << " drawn, "
+	          << losses << " lost, longest mate " << (table->_max_plies + 1) / 2 << " moves, " << generator._passes
+	          << " passes, " << table->_size << " bytes, " << seconds << " s" << std::endl;
+}
+
+int tablebaseMain(int argc, char* argv[]) {
+	/* command line generator:
+	 *   main tbgen <directory> [<material> ...] [--threads <n>]
+	 * without a material all pawnless sets of 3 and 4 pieces are generated. The
+	 * directory can be loaded with "main search --tb <directory>", the UCI option
+	 * TablebasePath, and is loaded by the game if it is named "tablebases".
+	 */
+	std::string directory;
+	std::vector<std::string> names;
+	int threads = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc)
+			threads = std::max(1, atoi(argv[++i]));
+		else if (directory.empty())
+			directory = arg;
+		else
+			names.push_back(arg);
+	}
+	if (directory.empty()) {
+		std::cout << "Usage: " << argv[0] << " tbgen <directory> [<material> ...] [--threads <n>]" << std::endl;
+		return 2;
+	}
+	if (names.empty()) {
+		for (int a = 0; a < 4; a++) {
+			names.push_back(tbCanonicalName(std::string(1, TB_FIGURES[a]), ""));
+			for (int b = a; b < 4; b++) {
+				names.push_back(tbCanonicalName(std::string(1, TB_FIGURES[a]) + TB_FIGURES[b], ""));
+				names.push_back(tbCanonicalName(std::string(1, TB_FIGURES[a]), std::string(1, TB_FIGURES[b])));
+			}
+		}
+	}
+
+	mkdir(directory.c_str(), 0755);
+	try {
+		for (const std::string& name : names) {
+			tbMaterial(name);  // throws for a wrong name before anything is generated
+			generateTablebase(directory, name, threads);
+		}
+	} catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 2;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A pool of worker threads, every worker has its own task queue. A worker takes
+ * its own tasks from the back of its queue, and once the queue is empty it steals
+ * from the front of the other workers' queues. This way the load is balanced even
+ * if the tasks take very different amounts of time (e.g. perft subtrees), without
+ * all threads fighting over one shared queue.
+ * All tasks are pushed before run() is called, a run ends when every queue is empty.
+ */
+template<typename Task>
+struct WorkStealingPool {
+	struct alignas(64) Worker {  // own cache line, the counters are written all the time
+		std::mutex _mutex;
+		std::deque<Task> _tasks;
+		uint64_t _executed = 0;       // tasks run by this worker, including stolen ones
+		uint64_t _steals = 0;         // tasks taken from another worker's queue
+		uint64_t _failed_steals = 0;  // queues found empty while looking for work
+	};
+	std::vector<std::unique_ptr<Worker>> _workers;
+
+	WorkStealingPool(int threads);
+	int size() const { return int(_workers.size()); }
+	void push(int worker, const Task& task);
+	template<typename Run> void run(Run run);
+
+	bool popOwn(Worker& worker, Task& task);
+	bool steal(int thief, Task& task);
+};
+
+template<typename Task>
+WorkStealingPool<Task>::WorkStealingPool(int threads) {
+	for (int i = 0; i < (threads > 0 ? threads : 1); i++)
+		_workers.push_back(std::make_unique<Worker>());
+}
+
+template<typename Task>
+void WorkStealingPool<Task>::push(int worker, const Task& task) {
+	Worker& w = *_workers[worker % size()];
+	std::lock_guard<std::mutex> lock(w._mutex);
+	w._tasks.push_back(task);
+}
+
+template<typename Task>
+bool WorkStealingPool<Task>::popOwn(Worker& worker, Task& task) {
+	std::lock_guard<std::mutex> lock(worker._mutex);
+	if (worker._tasks.empty())
+		return false;
+	task = std::move(worker._tasks.back());
+	worker._tasks.pop_back();
+	return true;
+}
+
+template<typename Task>
+bool WorkStealingPool<Task>::steal(int thief, Task& task) {
+	/* takes the oldest task of the first other worker that has one left
+	 */
+	Worker& w = *_workers[thief];
+	for (int i = 1; i < size(); i++) {
+		Worker& victim = *_workers[(thief + i) % size()];
+		std::lock_guard<std::mutex> lock(victim._mutex);
+		if (victim._tasks.empty()) {
+			w._failed_steals++;
+			continue;
+		}
+		task = std::move(victim._tasks.front());
+		victim._tasks.pop_front();
+		w._steals++;
+		return true;
+	}
+	return false;
+}
+
+template<typename Task>
+template<typename Run>
+void WorkStealingPool<Task>::run(Run run) {
+	/* calls run(worker_id, task) for every queued task and returns when all tasks
+	 * are done. The calling thread works as worker 0.
+	 */
+	auto work = [this, &run](int id) {
+		Worker& w = *_workers[id];
+		Task task;
+		while (popOwn(w, task) || steal(id, task)) {
+			run(id, task);
+			w._executed++;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int id = 1; id < size(); id++)
+		threads.emplace_back(work, id);
+	work(0);
+	for (std::thread& t : threads)
+		t.join();
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef TT_HPP
+#define TT_HPP
+
+#include "move.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+/* Transposition table: remembers results of earlier searches by position key,
+ * shared by all search threads.
+ *
+ * The table is an array of buckets, one bucket fills one cache line and holds
+ * four entries, so a probe costs at most one cache miss. An entry is two words,
+ * the data word and the key xored with the data word. Threads read and write
+ * without locks; if two threads write the same entry at the same time the two
+ * words may come from different writes, then the key check fails and the entry
+ * reads as empty (lockless hashing, Hyatt and Mann).
+ *
+ * Replacement: an entry of the same position is overwritten (unless it is from
+ * the current search and deeper, and the new result is not exact), otherwise the
+ * entry with the lowest depth counting older searches as less valuable is replaced.
+ */
+enum Bound : uint8_t {
+	BOUND_NONE,
+	BOUND_UPPER,  // score <= real value failed low
+	BOUND_LOWER,  // score >= real value failed high
+	BOUND_EXACT = BOUND_UPPER | BOUND_LOWER
+};
+
+struct TTData {
+	Move _move;
+	int16_t _score;
+	int16_t _eval;
+	int8_t _depth;
+	Bound _bound;
+	uint8_t _generation;
+};
+
+/* data word layout:
+ *  bits  0-15: move, 16-31: score, 32-47: static eval,
+ *  bits 48-55: depth, 56-57: bound, 58-63: generation
+ */
+inline uint64_t packTTData(const TTData& d) {
+	return uint64_t(d._move._data) | uint64_t(uint16_t(d._score)) << 16 | uint64_t(uint16_t(d._eval)) << 32
+	     | uint64_t(uint8_t(d._depth)) << 48 | uint64_t(d._bound) << 56 | uint64_t(d._generation & 63) << 58;
+}
+
+inline TTData unpackTTData(uint64_t data) {
+	return TTData {Move(uint16_t(data)), int16_t(data >> 16), int16_t(data >> 32),
+	               int8_t(data >> 48), Bound((data >> 56) & 3), uint8_t(data >> 58)};
+}
+
+struct TTEntry {
+	std::atomic<uint64_t> _key_xor_data {0};
+	std::atomic<uint64_t> _data {0};
+};
+
+const int TT_BUCKET_SIZE = 4;
+
+struct alignas(64) TTBucket {
+	TTEntry _entries[TT_BUCKET_SIZE];
+};
+
+struct TranspositionTable {
+	std::unique_ptr<TTBucket[]> _buckets;
+	uint64_t _bucket_count = 0;
+	uint8_t _generation = 0;  // 6 bits, increased with every new search
+
+	TranspositionTable(size_t megabytes = 16) { resize(megabytes); }
+	void resize(size_t megabytes);
+	void clear();
+	void newSearch() { _generation = (_generation + 1) & 63; }
+	TTBucket& bucket(uint64_t key) const { return _buckets[mulHigh(key, _bucket_count)]; }
+	bool probe(uint64_t key, TTData& data) const;
+	void store(uint64_t key, Move move, int score, int eval, int depth, Bound bound);
+	int hashfull() const;
+
+	// maps the key evenly to [0, n), uses all bits of the key and no division
+	static uint64_t mulHigh(uint64_t key, uint64_t n) { return uint64_t((unsigned __int128)key * n >> 64); }
+};
+
+void TranspositionTable::resize(size_t megabytes) {
+	/* the table holds as many buckets as fit into >>megabytes<<, all entries empty
+	 */
+	_bucket_count = std::max<uint64_t>(1, (uint64_t(megabytes) << 20) / sizeof(TTBucket));
+	_buckets.reset(new TTBucket[_bucket_count]);
+	_generation = 0;
+}
+
+void TranspositionTable::clear() {
+	for (uint64_t i = 0; i < _bucket_count; i++) {
+		for (TTEntry& e : _buckets[i]._entries) {
+			e._key_xor_data.store(0, std::memory_order_relaxed);
+			e._data.store(0, std::memory_order_relaxed);
+		}
+	}
+	_generation = 0;
+}
+
+bool TranspositionTable::probe(uint64_t key, TTData& data) const {
+	/* true if the position is in the table, its entry is stored in >>data<<
+	 */
+	for (TTEntry& e : bucket(key)._entries) {
+		uint64_t d = e._data.load(std::memory_order_relaxed);
+		if ((e._key_xor_data.load(std::memory_order_relaxed) ^ d) == key && d) {
+			data = unpackTTData(d);
+			return true;
+		}
+	}
+	return false;
+}
+
+void TranspositionTable::store(uint64_t key, Move move, int score, int eval, int depth, Bound bound) {
+	TTBucket& b = bucket(key);
+	TTEntry* replace = &b._entries[0];
+	int replace_value = 1 << 30;
+
+	for (TTEntry& e : b._entries) {
+		uint64_t d = e._data.load(std::memory_order_relaxed);
+		if ((e._key_xor_data.load(std::memory_order_relaxed) ^ d) == key && d) {
+			TTData old = unpackTTData(d);
+			if (bound != BOUND_EXACT && old._generation == _generation && old._depth > depth)
+				return;  // the deeper result of this search is more useful
+			if (!move)
+				move = old._move;  // keep the best move known for the position
+			replace = &e;
+			break;
+		}
+		// older searches count as 8 plies less deep, empty entries are replaced first
+		int value = d ? unpackTTData(d)._depth - 8 * ((_generation - unpackTTData(d)._generation) & 63) : -(1 << 30);
+		if (value < replace_value) {
+			replace_value = value;
+			replace = &e;
+		}
+	}
+
+	uint64_t data = packTTData(TTData {move, int16_t(score), int16_t(eval), int8_t(depth), bound, _generation});
+	replace->_key_xor_data.store(key ^ data, std::memory_order_relaxed);
+	replace->_data.store(data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull() const {
+	/* permille of the sampled entries that were written by the current search
+	 */
+	int used = 0;
+	uint64_t samples = std::min<uint64_t>(250, _bucket_count);
+	for (uint64_t i = 0; i < samples; i++) {
+		for (TTEntry& e : _buckets[i]._entries) {
+			uint64_t d = e._data.load(std::memory_order_relaxed);
+			used += d && unpackTTData(d)._generation == _generation;
+		}
+	}
+	return int(1000 * used / (samples * TT_BUCKET_SIZE));
+}
+
+#endif
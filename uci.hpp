@@ -0,0 +1,282 @@
+#ifndef UCI_HPP
+#define UCI_HPP
+
+#include "chess.hpp"
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+/* UCI (Universal Chess Interface) mode, for chess GUIs and match runners:
+ *   main uci         or "uci" typed at the first prompt of the game
+ * Supported commands: uci, isready, setoption (Hash, Threads, Move Overhead,
+ * Ponder, BookFile for a Polyglot book, TablebasePath, EvalFile in builds with
+ * -DUSE_NNUE), ucinewgame, position
+ * startpos|fen ... [moves ...], go [wtime btime winc binc movestogo movetime
+ * depth nodes infinite ponder], stop, ponderhit, quit.
+ *
+ * The search runs on its own thread, so the input is read while it searches.
+ * "stop" sets the abort flag, which the main search thread looks at every 256
+ * nodes, and the best move is sent well within a millisecond. Moves are written
+ * in UCI notation, e.g. "e2e4", "e1g1" for castling and "e7e8q" for promotions.
+ */
+
+string moveToUci(Move m) {
+	string uci = rowColToAlgebraic(rowOf(m.from()), colOf(m.from())) + rowColToAlgebraic(rowOf(m.to()), colOf(m.to()));
+	if (m.flag() == PROMOTION)
+		uci += char(tolower(FIGURE_CHARS[m.promotion()]));
+	return uci;
+}
+
+Move uciToMove(const Position& pos, const string& uci) {
+	/* the legal move written as >>uci<<, MOVE_NONE if there is none
+	 */
+	MoveList moves;
+	generateMoves(pos, moves);
+	for (Move m : moves) {
+		if (moveToUci(m) == uci)
+			return m;
+	}
+	return MOVE_NONE;
+}
+
+void allocateTime(SearchLimits& limits, int64_t time_ms, int64_t increment_ms, int moves_to_go, int64_t overhead_ms) {
+	/* time for one move from the clock: the optimum is an even share of the time
+	 * left over the moves still to play (30 if the time control does not say) plus
+	 * most of the increment, after it no new iteration is started. The hard limit
+	 * allows an iteration to run up to four times as long, but never uses more than
+	 * three quarters of the clock. The overhead is kept back for the communication
+	 * with the GUI, which matters most in bullet games.
+	 */
+	int64_t usable = max<int64_t>(1, time_ms - overhead_ms);
+	int moves = moves_to_go > 0 ? min(moves_to_go, 30) : 30;
+	int64_t maximum = max<int64_t>(1, min(usable * 3 / 4, (usable / moves + increment_ms * 3 / 4) * 4));
+	limits._optimum_ms = max<int64_t>(1, min(maximum, usable / moves + increment_ms * 3 / 4));
+	limits._movetime_ms = maximum;
+}
+
+struct UciEngine {
+	ChessBoard _board;  // the position of the last "position" command
+	SearchFeatures _features;
+	int64_t _move_overhead_ms = 20;
+	thread _search_thread;
+	atomic<bool> _abort {false};
+	atomic<bool> _ponder {false};
+	mutex _output_mutex;  // the search thread and the input loop both write
+
+	void loop(istream& in);
+	bool command(const string& line);
+	void position(istringstream& args);
+	void go(istringstream& args);
+	void stop();
+	void setOption(istringstream& args);
+	void send(const string& line);
+	void sendInfo(const SearchResult& result);
+};
+
+void UciEngine::send(const string& line) {
+	lock_guard<mutex> lock(_output_mutex);
+	cout << line << endl;
+}
+
+void UciEngine::loop(istream& in) {
+	string line;
+	while (getline(in, line) && command(line)) {}
+	stop();
+}
+
+bool UciEngine::command(const string& line) {
+	/* executes one line of input, false after "quit"
+	 */
+	istringstream args(line);
+	string command;
+	args >> command;
+
+	if (command == "uci") {
+		send("id name Chess73");
+		send("id author samox73");
+		send("option name Hash type spin default 16 min 1 max 65536");
+		send("option name Threads type spin default 1 min 1 max 256");
+		send("option name Move Overhead type spin default 20 min 0 max 5000");
+		send("option name Ponder type check default false");
+		send("option name BookFile type string default <empty>");
+		send("option name TablebasePath type string default <empty>");
+#ifdef USE_NNUE
+		send("option name EvalFile type string default <empty>");
+#endif
+		send("uciok");
+	} else if (command == "isready") {
+		if (!_board._tt)  // allocated now rather than in the first timed search
+			_board._tt = make_shared<TranspositionTable>(_board._hash_mb);
+		send("readyok");
+	} else if (command == "setoption") {
+		setOption(args);
+	} else if (command == "ucinewgame") {
+		stop();
+		if (_board._tt)
+			_board._tt->clear();
+		_board._pawn_tables.clear();
+	} else if (command == "position") {
+		stop();
+		position(args);
+	} else if (command == "go") {
+		go(args);
+	} else if (command == "stop") {
+		stop();
+	} else if (command == "ponderhit") {
+		_ponder = false;  // the time limits apply from now on
+	} else if (command == "quit") {
+		return false;
+	}
+	return true;
+}
+
+void UciEngine::setOption(istringstream& args) {
+	/* "setoption name <name> value <value>", names may contain spaces
+	 */
+	string token, name, value;
+	args >> token;  // "name"
+	while (args >> token && token != "value")
+		name += (name.empty() ? "" : " ") + token;
+	getline(args >> ws, value);
+
+	stop();
+	if (name == "Hash") {
+		_board._hash_mb = max(1, atoi(value.c_str()));
+		_board._tt.reset();
+	} else if (name == "Threads") {
+		_board._threads = max(1, atoi(value.c_str()));
+	} else if (name == "Move Overhead") {
+		_move_overhead_ms = max(0, atoi(value.c_str()));
+	} else if (name == "BookFile") {
+		try {
+			BOOK.load(value);
+		} catch (const exception& e) {
+			send(string("info string ") + e.what());
+		}
+	} else if (name == "TablebasePath") {
+		try {
+			vector<string> errors;
+			send("info string " + to_string(TABLEBASES.loadDirectory(value, errors)) + " tablebases loaded");
+			for (const string& error : errors)
+				send("info string " + error);
+		} catch (const exception& e) {
+			send(string("info string ") + e.what());
+		}
+	} else if (name == "EvalFile") {
+#ifdef USE_NNUE
+		try {
+			NNUE.load(value);
+		} catch (const exception& e) {
+			send(string("info string ") + e.what());
+		}
+#endif
+	}
+}
+
+void UciEngine::position(istringstream& args) {
+	/* "position startpos|fen <FEN> [moves <move> ...]"
+	 */
+	string token, fen;
+	args >> token;
+	if (token == "fen") {
+		while (args >> token && token != "moves")
+			fen += (fen.empty() ? "" : " ") + token;
+	} else {
+		fen = START_FEN;
+		args >> token;  // "moves"
+	}
+
+	try {
+		_board.loadFen(fen);
+	} catch (const exception& e) {
+		send(string("info string ") + e.what());
+		_board.loadFen(START_FEN);
+		return;
+	}
+	while (args >> token) {
+		Move m = uciToMove(_board._pos, token);
+		if (!m) {
+			send("info string illegal move " + token);
+			break;
+		}
+		_board.applyMove(m);
+	}
+}
+
+void UciEngine::go(istringstream& args) {
+	stop();
+	SearchLimits limits;
+	int64_t time[2] = {0, 0}, increment[2] = {0, 0};
+	int moves_to_go = 0;
+	bool infinite = false, ponder = false, clock = false;
+	string token;
+	while (args >> token) {
+		if (token == "wtime") { args >> time[WHITE]; clock = true; }
+		else if (token == "btime") { args >> time[BLACK]; clock = true; }
+		else if (token == "winc") args >> increment[WHITE];
+		else if (token == "binc") args >> increment[BLACK];
+		else if (token == "movestogo") args >> moves_to_go;
+		else if (token == "movetime") args >> limits._movetime_ms;
+		else if (token == "depth") args >> limits._depth;
+		else if (token == "nodes") args >> limits._nodes;
+		else if (token == "infinite") infinite = true;
+		else if (token == "ponder") ponder = true;
+	}
+	Color us = _board._pos.sideToMove();
+	if (clock && !limits._movetime_ms)
+		allocateTime(limits, time[us], increment[us], moves_to_go, _move_overhead_ms);
+	else if (limits._movetime_ms)
+		limits._movetime_ms = max<int64_t>(1, limits._movetime_ms - _move_overhead_ms);
+
+	_abort = false;
+	_ponder = ponder;
+	limits._abort = &_abort;
+	limits._ponder = &_ponder;
+
+	_search_thread = thread([this, limits, infinite]() {
+		SearchResult result = _board.search(limits, _features, false, [this](const SearchResult& r) { sendInfo(r); });
+		// searching infinite or pondering, the GUI expects no best move before "stop" or "ponderhit"
+		while ((infinite || _ponder) && !_abort)
+			this_thread::sleep_for(chrono::milliseconds(1));
+		string best = "bestmove " + (result._best_move ? moveToUci(result._best_move) : string("0000"));
+		if (result._pv.size() > 1 && result._pv[0] == result._best_move)
+			best += " ponder " + moveToUci(result._pv[1]);
+		send(best);
+	});
+}
+
+void UciEngine::stop() {
+	/* ends a running search, its best move is sent before this returns
+	 */
+	if (!_search_thread.joinable())
+		return;
+	_ponder = false;
+	_abort = true;
+	_search_thread.join();
+}
+
+void UciEngine::sendInfo(const SearchResult& result) {
+	ostringstream info;
+	info << "info depth " << result._depth << " score ";
+	if (abs(result._score) >= VALUE_MATE_IN_MAX_PLY)
+		info << "mate " << mateInMoves(result._score);
+	else
+		info << "cp " << result._score;
+	info << " nodes " << result._nodes
+	     << " nps " << uint64_t(result._seconds > 0 ? result._nodes / result._seconds : 0)
+	     << " time " << int64_t(result._seconds * 1000)
+	     << " hashfull " << _board._tt->hashfull() << " pv";
+	for (Move m : result._pv)
+		info << " " << moveToUci(m);
+	send(info.str());
+}
+
+int uciMain(const string& first_command = "") {
+	UciEngine engine;
+	engine._board.loadFen(START_FEN);  // for a "go" without a "position"
+	if (first_command.empty() || engine.command(first_command))
+		engine.loop(cin);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef ZOBRIST_HPP
+#define ZOBRIST_HPP
+
+#include "bitboard.hpp"
+
+/* Zobrist hashing: every (piece, square) pair, every castling right set, every en
+ * passant file and the side to move get a random 64 bit number, the key of a
+ * position is the xor of the numbers of everything that is present. Equal
+ * positions always have equal keys, different positions almost never do.
+ * The numbers are generated at compile time with a fixed seed, so keys are the
+ * same in every run and every build. Position keeps its key up to date while
+ * pieces are put, removed and moved, see Position::_key.
+ */
+struct ZobristKeys {
+	uint64_t _psq[16][64];  // [piece][square], only the valid Piece values are used
+	uint64_t _castling[16]; // [CastlingRight bits], the xor of the keys of the single rights
+	uint64_t _ep_file[8];
+	uint64_t _side;         // xored in if black is to move
+};
+
+constexpr uint64_t splitMix64(uint64_t& state) {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys makeZobristKeys() {
+	ZobristKeys keys {};
+	uint64_t state = 0x436865737337330AULL;
+	for (auto& piece_keys : keys._psq) {
+		for (uint64_t& key : piece_keys)
+			key = splitMix64(state);
+	}
+	for (int right = 1; right < 16; right <<= 1)
+		keys._castling[right] = splitMix64(state);
+	for (int rights = 0; rights < 16; rights++) {  // no rights hash to 0
+		if (rights & (rights - 1))
+			keys._castling[rights] = keys._castling[rights & -rights] ^ keys._castling[rights & (rights - 1)];
+	}
+	for (uint64_t& key : keys._ep_file)
+		key = splitMix64(state);
+	keys._side = splitMix64(state);
+	return keys;
+}
+
+constexpr ZobristKeys ZOBRIST = makeZobristKeys();
+
+#endif